@@ -0,0 +1,298 @@
+// alerts.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <fcntl.h>
+#include <time.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "alerts.h"
+
+
+static const char* rulenames[ ALERT_NUMRULES ] =
+{
+	"min-checks",
+	"slow-lookup",
+	"plot-drop",
+	"pool-silence",
+};
+
+
+static void window_init( window_t* w, time_t span )
+{
+	memset( w, 0, sizeof(window_t) );
+	w->span = span < ALERT_BUCKETS ? ALERT_BUCKETS : span;
+}
+
+
+// Slide the window forward so that time t falls in the newest bucket.
+// Amortized O(1): every bucket gets cleared at most once per time it was filled.
+static void window_advance( window_t* w, time_t t )
+{
+	const time_t b = t / ( w->span / ALERT_BUCKETS );
+	if ( !w->head )
+		w->head = b;
+	if ( b <= w->head )
+		return;
+	const time_t steps = b - w->head < ALERT_BUCKETS ? b - w->head : ALERT_BUCKETS;
+	for ( time_t k=1; k<=steps; ++k )
+	{
+		const int idx = (int) ( ( w->head + k ) % ALERT_BUCKETS );
+		w->total -= w->counts[ idx ];
+		w->counts[ idx ] = 0;
+		for ( int i=0; i<ALERT_LATBINS; ++i )
+		{
+			w->lattotal[ i ] -= w->lat[ idx ][ i ];
+			w->lat[ idx ][ i ] = 0;
+		}
+	}
+	w->head = b;
+}
+
+
+static void window_add( window_t* w, time_t t, int latbin )
+{
+	window_advance( w, t );
+	const time_t b = t / ( w->span / ALERT_BUCKETS );
+	if ( b <= w->head - ALERT_BUCKETS )
+		return;	// Too late for the window.
+	const int idx = (int) ( b % ALERT_BUCKETS );
+	w->counts[ idx ] += 1;
+	w->total += 1;
+	if ( latbin >= 0 )
+	{
+		w->lat[ idx ][ latbin ] += 1;
+		w->lattotal[ latbin ] += 1;
+	}
+}
+
+
+static int latency_bin( float durat )
+{
+	const float ms = durat * 1000.0f;
+	int b = (int) ( 2.0f * log2f( 1.0f + ( ms > 0 ? ms : 0 ) ) );
+	return b < 0 ? 0 : ( b >= ALERT_LATBINS ? ALERT_LATBINS-1 : b );
+}
+
+
+// Returns the upper edge of the latency bin in which the 99th percentile falls, in seconds.
+static float window_p99( const window_t* w, int* count )
+{
+	int n = 0;
+	for ( int i=0; i<ALERT_LATBINS; ++i )
+		n += w->lattotal[ i ];
+	if ( count )
+		*count = n;
+	if ( !n )
+		return 0.0f;
+	const int rank = ( n * 99 + 99 ) / 100;
+	int acc = 0;
+	int b = 0;
+	for ( b=0; b<ALERT_LATBINS-1; ++b )
+	{
+		acc += w->lattotal[ b ];
+		if ( acc >= rank )
+			break;
+	}
+	return ( exp2f( ( b + 1 ) * 0.5f ) - 1.0f ) / 1000.0f;
+}
+
+
+static void notify( alerts_t* a, int rule, const char* msg )
+{
+	const char* state = a->firing[ rule ] ? "FIRING" : "RESOLVED";
+	char line[ 256 ];
+	snprintf( line, sizeof(line), "%ld %s %s %s\n", (long) a->latest, rulenames[ rule ], state, msg );
+
+	if ( a->fifo )
+	{
+		// Non blocking: if nobody is listening on the pipe, the message is dropped.
+		const int fd = open( a->fifo, O_WRONLY | O_NONBLOCK );
+		if ( fd >= 0 )
+		{
+			const ssize_t written = write( fd, line, strlen(line) );
+			(void) written;
+			close( fd );
+		}
+	}
+
+	if ( a->cmd )
+	{
+		const pid_t pid = fork();
+		if ( pid == 0 )
+		{
+			// Keep the child from scribbling over our terminal image.
+			const int devnull = open( "/dev/null", O_RDWR );
+			if ( devnull >= 0 )
+			{
+				dup2( devnull, STDIN_FILENO );
+				dup2( devnull, STDOUT_FILENO );
+				dup2( devnull, STDERR_FILENO );
+			}
+			setenv( "ALERT_NAME", rulenames[ rule ], 1 );
+			setenv( "ALERT_STATE", state, 1 );
+			setenv( "ALERT_MESSAGE", msg, 1 );
+			execl( "/bin/sh", "sh", "-c", a->cmd, (char*) 0 );
+			_exit( 127 );
+		}
+		if ( pid < 0 )
+			perror( "fork" );
+	}
+}
+
+
+static void set_state( alerts_t* a, int rule, int cond, const char* msg )
+{
+	if ( !a->enabled[ rule ] || a->firing[ rule ] == cond )
+		return;
+	a->firing[ rule ] = cond;
+	if ( a->live )
+		notify( a, rule, msg );
+}
+
+
+static void evaluate_windows( alerts_t* a, time_t now )
+{
+	char msg[ 128 ];
+	if ( a->enabled[ ALERT_MIN_CHECKS ] )
+	{
+		// Only judge a window that we have fully observed.
+		const int cond = now - a->since >= a->checks.span && a->checks.total < a->min_checks;
+		snprintf( msg, sizeof(msg), "%d checks in last %d minutes", a->checks.total, (int) ( a->checks.span / 60 ) );
+		set_state( a, ALERT_MIN_CHECKS, cond, msg );
+	}
+	if ( a->enabled[ ALERT_SLOW_LOOKUP ] )
+	{
+		int n = 0;
+		const float p99 = window_p99( &a->lookups, &n );
+		const int cond = n > 0 && p99 > a->p99_limit;
+		snprintf( msg, sizeof(msg), "p99 lookup %.3fs over %d eligible checks", p99, n );
+		set_state( a, ALERT_SLOW_LOOKUP, cond, msg );
+	}
+	if ( a->enabled[ ALERT_POOL_SILENCE ] && a->last_partial )
+	{
+		const int cond = now - a->last_partial > a->pool_silence;
+		snprintf( msg, sizeof(msg), "no pool partials for %d minutes", (int) ( ( now - a->last_partial ) / 60 ) );
+		set_state( a, ALERT_POOL_SILENCE, cond, msg );
+	}
+}
+
+
+static int getenv_int( const char* name, int def )
+{
+	const char* str = getenv( name );
+	return str ? atoi( str ) : def;
+}
+
+
+void alerts_init( alerts_t* a )
+{
+	memset( a, 0, sizeof(alerts_t) );
+
+	a->cmd  = getenv( "ALERT_CMD" );
+	a->fifo = getenv( "ALERT_FIFO" );
+
+	a->min_checks = getenv_int( "ALERT_MIN_CHECKS", 0 );
+	a->enabled[ ALERT_MIN_CHECKS ] = a->min_checks > 0;
+	window_init( &a->checks, 60 * getenv_int( "ALERT_CHECK_MINUTES", 10 ) );
+
+	const char* str = getenv( "ALERT_P99_SECONDS" );
+	a->p99_limit = str ? atof( str ) : 0.0f;
+	a->enabled[ ALERT_SLOW_LOOKUP ] = a->p99_limit > 0.0f;
+	window_init( &a->lookups, 60 * getenv_int( "ALERT_P99_MINUTES", 60 ) );
+
+	a->plot_drop = getenv_int( "ALERT_PLOT_DROP", 0 );
+	a->plot_ref = -1;
+	a->enabled[ ALERT_PLOT_DROP ] = a->plot_drop > 0;
+
+	a->pool_silence = 3600 * getenv_int( "ALERT_POOL_HOURS", 0 );
+	a->enabled[ ALERT_POOL_SILENCE ] = a->pool_silence > 0;
+}
+
+
+void alerts_entry( alerts_t* a, time_t t, int eligi, float durat, int plots )
+{
+	if ( !a->since )
+		a->since = t;
+	a->latest = t > a->latest ? t : a->latest;
+
+	window_add( &a->checks, t, -1 );
+	if ( eligi > 0 )
+		window_add( &a->lookups, t, latency_bin( durat ) );
+
+	if ( a->enabled[ ALERT_PLOT_DROP ] )
+	{
+		char msg[ 128 ];
+		if ( !a->firing[ ALERT_PLOT_DROP ] )
+		{
+			if ( a->plot_ref >= 0 && plots <= a->plot_ref - a->plot_drop )
+			{
+				snprintf( msg, sizeof(msg), "plot count dropped from %d to %d", a->plot_ref, plots );
+				set_state( a, ALERT_PLOT_DROP, 1, msg );
+			}
+			else
+				a->plot_ref = plots;
+		}
+		else if ( plots >= a->plot_ref )
+		{
+			snprintf( msg, sizeof(msg), "plot count recovered to %d", plots );
+			set_state( a, ALERT_PLOT_DROP, 0, msg );
+			a->plot_ref = plots;
+		}
+	}
+
+	evaluate_windows( a, a->latest );
+}
+
+
+void alerts_partial( alerts_t* a, time_t t )
+{
+	a->last_partial = t > a->last_partial ? t : a->last_partial;
+}
+
+
+void alerts_tick( alerts_t* a, time_t now )
+{
+	if ( !a->live )
+		return;
+
+	// Reap the alert commands that have finished.
+	while ( waitpid( -1, 0, WNOHANG ) > 0 )
+		;
+
+	// No new entries may be the very thing we need to alert on, so let the windows slide with the clock.
+	window_advance( &a->checks,  now );
+	window_advance( &a->lookups, now );
+	a->latest = now > a->latest ? now : a->latest;
+	evaluate_windows( a, now );
+}
+
+
+void alerts_go_live( alerts_t* a, time_t now )
+{
+	a->live = 1;
+	if ( !a->since )
+		a->since = now;
+	// Report the conditions that were already bad during replay of the logs.
+	for ( int rule=0; rule<ALERT_NUMRULES; ++rule )
+		if ( a->firing[ rule ] )
+			notify( a, rule, "already active at start-up" );
+	alerts_tick( a, now );
+}
+
+
+int alerts_num_firing( const alerts_t* a )
+{
+	int n = 0;
+	for ( int rule=0; rule<ALERT_NUMRULES; ++rule )
+		n += a->firing[ rule ];
+	return n;
+}
+
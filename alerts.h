@@ -0,0 +1,64 @@
+// alerts.h
+//
+// by Abraham Stolk.
+
+// Rule engine that watches the harvest stream, and tells someone when things go bad.
+// All state is kept in sliding-window counters, so each entry costs O(1) to evaluate.
+
+#define ALERT_BUCKETS	60	// Resolution of a sliding window.
+#define ALERT_LATBINS	32	// Lookup-time histogram bins, two per octave of milliseconds.
+
+enum
+{
+	ALERT_MIN_CHECKS=0,
+	ALERT_SLOW_LOOKUP,
+	ALERT_PLOT_DROP,
+	ALERT_POOL_SILENCE,
+	ALERT_NUMRULES
+};
+
+typedef struct window
+{
+	time_t		span;					// Length of window in seconds.
+	time_t		head;					// Bucket number of newest bucket.
+	int		total;					// Nr of samples in window.
+	int		counts[ ALERT_BUCKETS ];
+	int		lattotal[ ALERT_LATBINS ];
+	uint16_t	lat[ ALERT_BUCKETS ][ ALERT_LATBINS ];
+} window_t;
+
+typedef struct alerts
+{
+	int		enabled[ ALERT_NUMRULES ];
+	int		firing[ ALERT_NUMRULES ];
+	int		live;			// Only fire when we are past the replay of old logs.
+
+	int		min_checks;		// Fire if fewer than this many checks ...
+	window_t	checks;			// ... in this window.
+	float		p99_limit;		// Fire if p99 of eligible lookups exceeds this many seconds ...
+	window_t	lookups;		// ... in this window.
+	int		plot_drop;		// Fire if plot count drops by at least this many.
+	int		plot_ref;		// Plot count before the drop.
+	time_t		pool_silence;		// Fire if no pool partials for this many seconds.
+	time_t		last_partial;
+
+	time_t		since;			// Time of first observation.
+	time_t		latest;			// Time of last observation.
+
+	const char*	cmd;			// Shell command to run on state changes.
+	const char*	fifo;			// Named pipe to write state changes to.
+} alerts_t;
+
+
+extern void alerts_init( alerts_t* a );
+
+extern void alerts_entry( alerts_t* a, time_t t, int eligi, float durat, int plots );
+
+extern void alerts_partial( alerts_t* a, time_t t );
+
+extern void alerts_tick( alerts_t* a, time_t now );
+
+extern void alerts_go_live( alerts_t* a, time_t now );
+
+extern int  alerts_num_firing( const alerts_t* a );
+
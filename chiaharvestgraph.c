@@ -14,170 +14,151 @@
 #include <sys/select.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <stdint.h>
 #include <limits.h>
 #include <errno.h>
 #include <err.h>
 #include <string.h>
 #include <termios.h>
 
+#include "harvestgraph.h"
 #include "grapher.h"
 #include "colourmaps.h"
+#include "alerts.h"
+#include "instrument.h"
+#include "remote.h"
+#include "publish.h"
+#include "imgwrite.h"
+#include "linereader.h"
 
 
 #define MAXLINESZ		1024
 
 #define WAIT_BETWEEN_SELECT_US	500000L
 
-#define	MAXHIST			( 4 * 24 * 7 )	// A week's worth of quarter-hours.
-#define MAXENTR			( 12 * 15 )	// We expect 6 per minute, worst-case: 12 per min, 180 per quarter-hr.
+#define STREAMBUFSZ		( 1<<20 )	// Read buffer for a log that comes in through a pipe.
+#define STREAMBUDGET		( 8<<20 )	// Bytes to take from the pipe, before we get back to drawing.
 
-typedef struct quarterhr
-{
-	time_t	stamps[ MAXENTR ];
-	int	eligib[ MAXENTR ];
-	int	proofs[ MAXENTR ];
-	int	poolpr[ MAXENTR ];
-	float	durati[ MAXENTR ];
-	int	sz;
-	time_t	timelo;
-	time_t	timehi;
-} quarterhr_t;
+#define NUMCMAPS		4
+
+#define DAYS_SAVE_SECS		60	// How often we write the daily totals, if they changed.
 
 
-quarterhr_t quarters[ MAXHIST ];
+static harvestgraph_t* hg = 0;	// Our history of the harvest, and all that is needed to build it from the logs.
 
-static int entries_added=0;	// How many log entries have we added in total?
+static int64_t refresh_stamp=0;	// When did we update the image, last?
 
-static time_t newest_stamp=0;	// The stamp of the latest entry.
+static struct termios orig_termios;
 
-static time_t refresh_stamp=0;	// When did we update the image, last?
+static const rgb_t* ramp=cmap_heat;
 
-static int pool_proof_seen=0;	// Did we ever see a pool proof?
+static const rgb_t* cmaps[ NUMCMAPS ] = { cmap_heat, cmap_viridis, cmap_magma, cmap_plasma };
 
-static struct termios orig_termios;
+static int cmapnr=0;
+
+static hg_palette_t palettes[ NUMCMAPS ];	// Packed RGBA of every colour map, normal and banded.
+
+static int render_invalid=1;			// Must we redraw, even if there are no new entries?
+
+static int show_debug=0;			// Show our own performance counters in the overlay?
 
-static const rgb_t* ramp=0;
+static int drawnsz[ HG_NUM_COLUMNS ];		// Nr of entries in the quarter, when its column was drawn.
+static time_t drawnlo[ HG_NUM_COLUMNS ];	// Start of that quarter, so that we notice a shift.
+static int drawnruns=-1;			// Nr of plot count runs, when we drew the columns.
+static int64_t drawnoldest=-1;			// Oldest stamp, when we drew the columns.
+static int drawnpool=-1;			// Did we know of pool proofs, when we drew the columns?
 
-static double total_response_time_eligible=0.0;
-static double worst_response_time_eligible=0.0;
-static int total_eligible_responses=0;
-static int plotcount=-1;
-static time_t oldeststamp;
+static int has_access_to_farmer_log=0;		// As far as the legend knows.
 
-static int has_access_to_farmer_log=0;
+static alerts_t alerts;
 
+static int agent_mode=0;	// Do we ship our entries to a viewer?
 
-static void init_quarters( time_t now )
+static int viewer_mode=0;	// Do we show the entries of remote agents?
+
+static int agent_plots[ REMOTE_MAXAGENTS ];	// Latest plot count of each agent.
+static int total_plots=0;			// Sum of those.
+
+
+// Every entry that makes it into the history, is also checked by the alert rules, and shipped to the viewer if we are an agent.
+static void on_entry( void* user, const hg_entry_t* e, int farmplots )
 {
-	time_t q = now / 900;
-	time_t q_lo = (q+0) * 900;
-	time_t q_hi = (q+1) * 900;
-	for ( int i=MAXHIST-1; i>=0; --i )	// [0..MAXHIST)
+	(void)user;
+	alerts_entry( &alerts, (time_t) ( e->t / 1000 ), e->eligi, e->durat, farmplots );
+	if ( agent_mode )
 	{
-		const int ir = MAXHIST-1-i;	// [MAXHIST-1..0]
-		quarters[i].sz = 0;
-		quarters[i].timelo = q_lo - 900 * ir;
-		quarters[i].timehi = q_hi - 900 * ir;
+		const record_t r = { e->t, e->eligi, e->proof, e->durat, e->plots };
+		agent_record( &r );
 	}
 }
 
 
-static void shift_quarters( void )
+static void on_partial( void* user, int64_t t )
 {
-	fprintf( stderr, "Shifting quarters...\n" );
-	for ( int i=0; i<MAXHIST-1; ++i )
-		quarters[i] = quarters[i+1];
-	const int last = MAXHIST-1;
-	memset( quarters+last, 0, sizeof(quarterhr_t) );
-	quarters[ last ].timelo = quarters[ last-1 ].timelo + 900;
-	quarters[ last ].timehi = quarters[ last-1 ].timehi + 900;
+	(void)user;
+	alerts_partial( &alerts, (time_t) ( t / 1000 ) );
 }
 
 
-static int too_old( time_t t )
+static void setup_history( void )
 {
-	return t <= quarters[ 0 ].timelo;
+	hg = hg_create( time(0) );
+	if ( !hg )
+		err( EXIT_FAILURE, "failed to set up the history" );
+	// The filter gets tightened by the network over time, so let the user change it.
+	const char* str = getenv( "PLOT_FILTER" );
+	hg_set_plot_filter( hg, str ? atoi( str ) : 0 );
+	hg_on_entry( hg, on_entry, 0 );
+	hg_on_partial( hg, on_partial, 0 );
 }
 
 
-static int too_new( time_t t )
+// The history does its own counting. Copy it into ours, before we show them.
+static void sync_counters( void )
 {
-	const int last = MAXHIST-1;
-	return t >= quarters[last].timehi;
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	INSTR_COUNT( CNT_MATCHED,  st.matched  - instr_counters[ CNT_MATCHED  ] );
+	INSTR_COUNT( CNT_REJECTED, st.rejected - instr_counters[ CNT_REJECTED ] );
+	INSTR_COUNT( CNT_SHIFTS,   st.shifts   - instr_counters[ CNT_SHIFTS   ] );
 }
 
 
-static int quarterslot( time_t tim )
+static void dump_counters( void )
 {
-	const int last = MAXHIST-1;
-	const time_t d = tim - quarters[last].timehi;
-	if ( d >= 0 )
-		return INT_MAX;
-	const int slot = (int) ( MAXHIST - 1 + ( d / 900 ) );
-	if ( slot < 0 )
-	{
-		fprintf
-		(
-			stderr,
-			"err - UNEXPECTED TIME VALUE.\n"
-			"tim=%zd lasttimehi=%zd d=%zd slot=%d\n"
-			"REPORT THIS MESSAGE TO %s\n",
-			tim, quarters[last].timehi, d, slot,
-			"https://github.com/stolk/chiaharvestgraph/issues/12"
-		);
-	}
-	return slot;
+	sync_counters();
+	instr_dump( stderr );
+	hg_grammar_dump( hg, stderr );
 }
 
 
-static int add_entry( time_t t, int eligi, int proof, float durat, int plots )
-{
-	while ( too_new( t ) )
-		shift_quarters();
-	if ( too_old( t ) )
-		return 0;	// signal not adding.
-	int s = quarterslot( t );
-	if ( s < 0 || s >= MAXHIST )
-		return -1;	// signal failure.
-	const int i = quarters[s].sz;
-	assert( i < MAXENTR );
-	quarters[s].stamps[i] = t;
-	quarters[s].eligib[i] = eligi;
-	quarters[s].proofs[i] = proof;
-	quarters[s].poolpr[i] = 0;
-	quarters[s].durati[i] = durat;
-	quarters[s].sz += 1;
+static FILE* f_log = 0;
 
-	if ( eligi > 0 )
-	{
-		total_response_time_eligible += durat;
-		worst_response_time_eligible = durat > worst_response_time_eligible ? durat : worst_response_time_eligible;
-		total_eligible_responses += 1;
-	}
-	if ( plotcount == -1 )
-		oldeststamp = t;
-	plotcount = plots;
-	oldeststamp = t < oldeststamp ? t : oldeststamp;
-	return 1;
-}
+static dev_t f_log_dev;		// Identity of the file we are reading, so that we can tell when it gets rotated.
+static ino_t f_log_ino;
 
+static char* carry = 0;		// Incomplete last line of the log, waiting for the rest to be written.
+static size_t carrysz = 0;
+static size_t carrylen = 0;
 
-static int mark_proof_as_a_pool_proof( time_t tim )
-{
-	int s = quarterslot( tim );
-	if ( s < 0 || s >= MAXHIST )
-		return -1;
-	const int i = quarters[s].sz - 1;
-	if ( i < 0 )
-		return -1;
-	quarters[s].poolpr[i] += 1;
-	pool_proof_seen = 1;
-	return 0;
-}
+static linereader_t stream = { -1 };	// Log lines that come from a pipe or FIFO, instead of from a directory.
+static int stream_keys = 0;		// Should a wait for the stream also wake up for key presses?
+static int stream_follow = 0;		// Is the stream a live log, that we keep reading?
 
 
-static FILE* f_log = 0;
+static int num_debug_logs( void )
+{
+	int numdebuglogs=8;
+	const char* str = getenv("NUM_DEBUG_LOGS");
+	if ( str )
+	{
+		numdebuglogs=atoi(str);
+		assert(numdebuglogs>0);
+	}
+	return numdebuglogs;
+}
 
 
 static FILE* open_log_file(const char* dirname, const char* logname)
@@ -195,6 +176,14 @@ static FILE* open_log_file(const char* dirname, const char* logname)
 		fprintf( stderr, "Failed to open log file '%s'\n", fname );
 		return 0;
 	}
+	struct stat st;
+	if ( fstat( fileno( f_log ), &st ) == 0 )
+	{
+		f_log_dev = st.st_dev;
+		f_log_ino = st.st_ino;
+	}
+	carrylen = 0;
+	hg_new_source( hg );	// A file from an older version can be next, when reading the rotated logs.
 
 #if 0	// No need for non blocking IO.
 	const int fd = fileno( f_log );
@@ -255,144 +244,64 @@ static void setup_postscript(void)
 	);
 }
 
+// The history has no use for a time stamp that makes no sense, and neither have we. Stop right there, so the user can see it.
+static void bad_stamp( void )
+{
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	fprintf
+	(
+		stderr,
+		"err - UNEXPECTED TIME VALUE.\n"
+		"OFFENDING LOG ENTRY AT: %lld.%03d, the history ends at %lld\n"
+		"REPORT THIS MESSAGE TO %s\n",
+		(long long) ( st.bad_stamp / 1000 ), (int) ( st.bad_stamp % 1000 ), (long long) st.bad_slot_end,
+		"https://github.com/stolk/chiaharvestgraph/issues/12"
+	);
+	exit(3);
+}
+
 
-// Parses log entries that look like this:
-// 2025-11-26T22:26:23.974 2.5.7 harvester chia.harvester.harvester: INFO     challenge_hash: 1d87c10291 ...2 plots were eligible for farming challengeFound 0 V1 proofs and 0 V2 qualities. Time: 0.07465 s. Total 252 plots
+static void analyze_line( const char* line, ssize_t length )
+{
+	if ( hg_feed_line( hg, line, length ) < 0 )
+		bad_stamp();
+}
 
-// NOTE: If followed by a line that looks like: "Submitting partial for" then it was a pooled proof.
 
-static void analyze_line(const char* line, ssize_t length)
+// Whatever is older than the slack, will not be overtaken anymore.
+static void commit_entries( void )
 {
-	if ( length > 60 )
+	if ( hg_caught_up( hg, (int64_t) time(0) * 1000 ) < 0 )
+		bad_stamp();
+}
+
+
+static void commit_all_entries( void )
+{
+	if ( hg_end_of_input( hg ) < 0 )
+		bad_stamp();
+}
+
+
+
+// Holds on to a partial line, so that a line that is read while it is being written, is not lost.
+static void append_to_carry( const char* s, size_t len )
+{
+	if ( carrylen + len + 1 > carrysz )
 	{
-		const char* from_harvester = strstr( line, " harvester " );
-		const char* from_farmer    = strstr( line, " farmer " );
-		if ( from_farmer && !has_access_to_farmer_log )
-		{
-			has_access_to_farmer_log = 1;
-			setup_postscript();
-		}
-		if ( from_harvester && strstr( line, "eligible" ) )
-		{
-			int year=-1;
-			int month=-1;
-			int day=-1;
-			int hours=-1;
-			int minut=-1;
-			float secon=-1;
-			char crypto[128];
-			char key[128];
-			int eligi = -1;
-			int proof = -1;
-			int qual = -1;
-			float durat = -1.0f;
-			int plots = -1;
-			char versio[32];
-			const int num = sscanf
-			(
-				line,
-				"%04d-%02d-%02dT%02d:%02d:%f %s harvester %[^.].harvester.harvester: INFO     challenge_hash: %s ..."
-				"%d plots were eligible for farming challengeFound %d V1 proofs and %d V2 qualities. Time: %f s. Total %d plots",
-				&year,
-				&month,
-				&day,
-				&hours,
-				&minut,
-				&secon,
-				versio,
-				crypto,
-				key,
-				&eligi,
-				&proof,
-				&qual,
-				&durat,
-				&plots
-			);
-			if ( num == 14 )
-			{
-				struct tm tim =
-				{
-					(int)secon,	// seconds 0..60
-					minut,		// minutes 0..59
-					hours,		// hours 0..23
-					day,		// day 1..31
-					month-1,	// month 0..11
-					year-1900,	// year - 1900
-					-1,
-					-1,
-					-1
-				};
-				const time_t logtim = mktime( &tim );
-				assert( logtim != (time_t) -1 );
-
-				if ( logtim > newest_stamp )
-				{
-					const int added = add_entry( logtim, eligi, proof, durat, plots );
-					if ( added < 0)
-					{
-						fprintf( stderr, "OFFENDING LOG LINE: %s\n", line );
-						exit(3); // Stop right there, so the user can see the message.
-					}
-					if ( added > 0)
-					{
-						newest_stamp = logtim;
-						entries_added += added;
-					}
-				}
-				else
-				{
-					// Sometimes a whole bunch of harvester runs are done in the very same second. Why?
-					//fprintf(stderr, "Spurious entry: %s", line);
-				}
-			}
-		}
-		if ( from_farmer && strstr(line, "Submitting partial for") )
-		{
-			// Last proof we found was a pooled proof.
-			// We should record this fact.
-			int year=-1;
-			int month=-1;
-			int day=-1;
-			int hours=-1;
-			int minut=-1;
-			float secon=-1;
-			const int num = sscanf
-			(
-				line,
-				"%04d-%02d-%02dT%02d:%02d:%f farmer ",
-				&year,
-				&month,
-				&day,
-				&hours,
-				&minut,
-				&secon
-			);
-			if ( num == 6 )
-			{
-				struct tm tim =
-				{
-					(int)secon,	// seconds 0..60
-					minut,		// minutes 0..59
-					hours,		// hours 0..23
-					day,		// day 1..31
-					month-1,	// month 0..11
-					year-1900,	// year - 1900
-					-1,
-					-1,
-					-1
-				};
-				const time_t logtim = mktime( &tim );
-				assert( logtim != (time_t) -1 );
-				mark_proof_as_a_pool_proof( logtim );
-			}
-		}
+		carrysz = 2 * ( carrylen + len + 1 );
+		carry = (char*) realloc( carry, carrysz );
+		assert( carry );
 	}
+	memcpy( carry + carrylen, s, len );
+	carrylen += len;
+	carry[ carrylen ] = 0;
 }
 
 
-static int read_log_file(void)
+static int read_log_lines(void)
 {
-	assert( f_log );
 	static char* line = 0;
 	static size_t linesz=MAXLINESZ;
 	if ( !line )
@@ -415,6 +324,7 @@ static int read_log_file(void)
 		if ( ready == 0 )
 		{
 			//fprintf( stderr, "No descriptors ready for reading.\n" );
+			commit_entries();
 			return linesread;
 		}
 
@@ -423,90 +333,237 @@ static int read_log_file(void)
 		{
 			//fprintf( stderr, "getline() returned %zd\n", ll );
 			clearerr( f_log );
+			// Caught up with the log: whatever is older than the slack, will not be overtaken anymore.
+			commit_entries();
 			return linesread;
 		}
 
+		if ( line[ ll-1 ] != '\n' )
+		{
+			// The writer is not done with this line yet. We will get the rest, next time.
+			append_to_carry( line, ll );
+			clearerr( f_log );
+			continue;
+		}
+
 		linesread++;
-		analyze_line( line, ll );
+		INSTR_COUNT( CNT_LINES, 1 );
+		if ( carrylen )
+		{
+			append_to_carry( line, ll );
+			analyze_line( carry, carrylen );
+			carrylen = 0;
+		}
+		else
+			analyze_line( line, ll );
 	} while(1);
 }
 
 
-static void draw_column( int nr, uint32_t* img, int h, time_t now )
+static int read_log_file(void)
+{
+	if ( !f_log )
+		return 0;
+	INSTR_BEGIN( t0 );
+	const int linesread = read_log_lines();
+	INSTR_END( STAGE_READ, t0 );
+	return linesread;
+}
+
+
+// Reads the log until its end, including a last line without a newline.
+static int drain_log_file( void )
+{
+	int numl = read_log_file();
+	if ( carrylen )
+	{
+		analyze_line( carry, carrylen );
+		carrylen = 0;
+		numl++;
+	}
+	return numl;
+}
+
+
+// Checks if debug.log is still the file that we are reading from. If it got rotated, we first drain the old
+// file to the end, and only then switch to the new one. That way, no line is lost, and no line is read twice.
+static void follow_log_rotation( const char* dirname )
 {
-	const int q = MAXHIST-1-nr;
-	if ( q<0 )
+	char fname[PATH_MAX+1];
+	snprintf( fname, sizeof(fname), "%s/debug.log", dirname );
+	struct stat st;
+	if ( stat( fname, &st ) )
+	{
+		// Renamed, but the new one is not there yet. Keep reading what the writer puts into the old one.
+		read_log_file();
 		return;
-	const time_t qlo = quarters[q].timelo;
-	const int sz = quarters[q].sz;
-	const int band = ( ( qlo / 900 / 4 ) & 1 );
-	for ( int y=0; y<h; ++y )
-	{
-		const int y0 = y>0   ?  y-1 : y+0;
-		const int y1 = y<h-1 ?  y+2 : y+1;
-		const time_t r0 = qlo + 900 * (y0 ) / h;
-		const time_t r1 = qlo + 900 * (y1 ) / h;
-		const time_t s0 = qlo + 900 * (y+0) / h;
-		const time_t s1 = qlo + 900 * (y+1) / h;
-
-		int checks=0;
-		int eligib=0;
-		int proofs=0;
-		int poolpr=0;
-		for ( int i=0; i<sz; ++i )
-		{
-			const time_t t = quarters[q].stamps[i];
-			if ( t >= r0 && t < r1 )
-				checks++;
-			if ( t >= s0 && t < s1 )
-			{
-				eligib += quarters[q].eligib[i];
-				proofs += quarters[q].proofs[i];
-				poolpr += quarters[q].poolpr[i];
-			}
-		}
-		(void)eligib;
-		(void)poolpr;
-		const time_t span = r1-r0;
-		const float nominalcheckspersecond = 9.375f;
-		const float nominalsecondspercheck = 1 / nominalcheckspersecond;
-		const float expected = span * nominalsecondspercheck;
-		float achieved = 0.73f * checks / expected;
-		achieved = achieved > 1.0f ? 1.0f : achieved;
-		const uint8_t idx = (uint8_t) ( achieved * 255 );
-		uint32_t red = ramp[idx][0];
-		uint32_t grn = ramp[idx][1];
-		uint32_t blu = ramp[idx][2];
-		if ( s0 < oldeststamp || s1 > now )
+	}
+	if ( f_log && st.st_dev == f_log_dev && st.st_ino == f_log_ino )
+	{
+		// Still the same file. But if it got truncated (copytruncate style rotation) start from the top.
+		struct stat cur;
+		if ( fstat( fileno( f_log ), &cur ) == 0 && cur.st_size < ftello( f_log ) )
 		{
-			red = grn = blu = 0x36;
+			fprintf( stderr, "Logfile got truncated.\n" );
+			rewind( f_log );
+			carrylen = 0;
 		}
-		if ( band )
+		return;
+	}
+	int numl = drain_log_file();
+
+	// The log may have been rotated more than once since we last looked.
+	// Find out where our file went, and read the files that came after it.
+	int k = 0;
+	const int numdebuglogs = num_debug_logs();
+	for ( int i=1; i<numdebuglogs && !k; ++i )
+	{
+		snprintf( fname, sizeof(fname), "%s/debug.log.%d", dirname, i );
+		if ( f_log && !stat( fname, &st ) && st.st_dev == f_log_dev && st.st_ino == f_log_ino )
+			k = i;
+	}
+	for ( int i=k-1; i>=1; --i )
+	{
+		char logfilename[80];
+		snprintf( logfilename, sizeof(logfilename), "debug.log.%d", i );
+		if ( open_log_file( dirname, logfilename ) )
+			numl += drain_log_file();
+	}
+
+	fprintf( stderr, "Reopening logfile.\n" );
+	open_log_file( dirname, 0 );
+	numl += read_log_file();
+	fprintf( stderr, "read %d lines from rotated and new logs.\n", numl );
+}
+
+
+static void analyze_stream_line( const char* line, ssize_t length )
+{
+	INSTR_COUNT( CNT_LINES, 1 );
+	analyze_line( line, length );
+}
+
+
+// A name of '-' means stdin, and a FIFO is read as it is. Anything else is a directory with debug.log files in it.
+// When stdin is the log, keys are read from the terminal, which becomes our stdin.
+// To follow a FIFO, we keep reading when a writer goes away, instead of seeing the end of the log.
+static int open_log_stream( const char* name, int keyboard, int follow )
+{
+	int fd = -1;
+	if ( !strcmp( name, "-" ) )
+	{
+		fd = dup( STDIN_FILENO );
+		if ( fd < 0 )
+			err( EXIT_FAILURE, "dup() failed" );
+		if ( keyboard )
 		{
-			red = red * 200 / 255;
-			grn = grn * 200 / 255;
-			blu = blu * 200 / 255;
+			const int tty = open( "/dev/tty", O_RDONLY );
+			if ( tty < 0 || dup2( tty, STDIN_FILENO ) < 0 )
+				err( EXIT_FAILURE, "failed to open the terminal for the keyboard" );
+			close( tty );
 		}
-		if ( proofs )
+	}
+	else
+	{
+		struct stat st;
+		if ( stat( name, &st ) || !S_ISFIFO( st.st_mode ) )
+			return 0;
+		// Also opened for writing, so that we do not get an end-of-file every time that a writer goes away.
+		fd = open( name, follow ? O_RDWR : O_RDONLY );
+		if ( fd < 0 )
+			err( EXIT_FAILURE, "failed to open '%s'", name );
+	}
+	if ( linereader_init( &stream, fd, STREAMBUFSZ ) )
+		err( EXIT_FAILURE, "failed to set up reading from '%s'", name );
+	stream_keys = keyboard;
+	stream_follow = follow;
+	return 1;
+}
+
+
+// Waits at most idle_secs for log lines (or a key press) and takes what the pipe has for us.
+static void service_log_stream( unsigned int idle_secs )
+{
+	fd_set rdset;
+	FD_ZERO( &rdset );
+	int maxfd = -1;
+	if ( !stream.eof )
+	{
+		FD_SET( stream.fd, &rdset );
+		maxfd = stream.fd;
+	}
+	if ( stream_keys )
+	{
+		FD_SET( STDIN_FILENO, &rdset );
+		maxfd = STDIN_FILENO > maxfd ? STDIN_FILENO : maxfd;
+	}
+	// Come back soon, to adapt once the terminal stops changing size.
+	struct timeval tv = { idle_secs, 0 };
+	if ( grapher_resized && im )
+		tv = (struct timeval) { 0, 50000L };
+	const int ready = select( maxfd+1, &rdset, NULL, NULL, &tv );
+	if ( ready < 0 && errno != EINTR )
+		err( EXIT_FAILURE, "select() failed" );
+	if ( ready > 0 && !stream.eof && FD_ISSET( stream.fd, &rdset ) )
+	{
+		INSTR_BEGIN( t0 );
+		linereader_pump( &stream, STREAMBUDGET, analyze_stream_line );
+		INSTR_END( STAGE_READ, t0 );
+		if ( stream.eof )
 		{
-			// Eureka! We found a proof, and will probably get paid sweet XCH!
-			if ( !pool_proof_seen )
-			{
-				// We didn't see pool proofs... this must be a solo proof. Show in dark blue.
-				red=0x40; grn=0x40; blu=0xff;
-			}
-			else
-			{
-				// We get pool proofs. This can't be a solo proof. Show in cyan.
-				red=0x20; grn=0xe0, blu=0xe0;
-			}
+			fprintf( stderr, "End of log stream.\n" );
+			commit_all_entries();	// Nothing can overtake these anymore.
+			return;
 		}
-		const uint32_t c = (0xff<<24) | (blu<<16) | (grn<<8) | (red<<0);
-		img[ y*imw ] = c;
 	}
+	// A live log is caught up with the clock when the pipe runs dry. An archive is not: it can pause anywhere, and the
+	// lines after the pause may still have to overtake the ones before it. So those are only committed at the end.
+	if ( stream_follow && ( stream.caughtup || ready == 0 ) )
+		commit_entries();
 }
 
 
+static void drain_log_stream( void )
+{
+	while ( !stream.eof )
+		service_log_stream( 1 );
+}
+
+
+static uint32_t pack_rgb( uint32_t red, uint32_t grn, uint32_t blu )
+{
+	return (0xffu<<24) | (blu<<16) | (grn<<8) | (red<<0);
+}
+
+
+// Precompute the final pixel colours for all colour maps, so that drawing a pixel is a single table look-up.
+static void setup_luts(void)
+{
+	for ( int band=0; band<2; ++band )
+	{
+		const uint32_t num = band ? 200 : 255;	// Every other hour is drawn a little darker.
+		for ( int m=0; m<NUMCMAPS; ++m )
+			for ( int idx=0; idx<256; ++idx )
+				palettes[ m ].ramp[ band ][ idx ] = pack_rgb
+				(
+					cmaps[ m ][ idx ][ 0 ] * num / 255,
+					cmaps[ m ][ idx ][ 1 ] * num / 255,
+					cmaps[ m ][ idx ][ 2 ] * num / 255
+				);
+		for ( int m=0; m<NUMCMAPS; ++m )
+			palettes[ m ].grey[ band ] = pack_rgb( 0x36 * num / 255, 0x36 * num / 255, 0x36 * num / 255 );
+	}
+}
+
+
+static void cycle_colourmap(void)
+{
+	cmapnr = ( cmapnr + 1 ) % NUMCMAPS;
+	ramp = cmaps[ cmapnr ];
+	setup_postscript();
+	render_invalid = 1;
+}
+
 static void setup_scale(void)
 {
 	strncpy( overlay + 2*imw - 4, "NOW", 4 );
@@ -528,11 +585,12 @@ static void setup_scale(void)
 }
 
 
-static void place_stats_into_overlay(void)
+
+static void place_stats_into_overlay( const hg_stats_t* st )
 {
-	double avg = total_response_time_eligible / total_eligible_responses;
+	double avg = st->avg_check;
 	int avgms   = (int)round(avg * 1000);
-	int worstms = (int)round(worst_response_time_eligible * 1000);
+	int worstms = (int)round(st->worst_check * 1000);
 
 	const char* q_av = 0;
 	if ( avgms < 80 )
@@ -552,48 +610,151 @@ static void place_stats_into_overlay(void)
 	else
 		q_wo = "too-slow";
 
+	char q_pl[24] = "";
+	const int missing = st->plots_missing;
+	if ( missing > 0 )
+		snprintf( q_pl, sizeof(q_pl), "[%d MISSING]", missing );
+
+	const int firing = alerts_num_firing( &alerts );
+	char q_al[16] = "";
+	if ( firing )
+		snprintf( q_al, sizeof(q_al), "ALERTS:%d", firing );
+
+	char q_sp[40] = "";
+	if ( st->farmer_log )
+	{
+		// Signage point latency, over the last hour.
+		const time_t now = time(0);
+		const int p50 = hg_sp_latency( hg, now - 3600, now + 1, 50 );
+		const int p95 = hg_sp_latency( hg, now - 3600, now + 1, 95 );
+		if ( p50 >= 0 )
+			snprintf( q_sp, sizeof(q_sp), "SP-LATENCY:%d/%dms", p50, p95 );
+	}
+
+	char q_ef[40] = "";
+	{
+		// Are all the plots searched? Over the last day, or EFF_WINDOW_HOURS.
+		const char* str = getenv( "EFF_WINDOW_HOURS" );
+		const int hours = str && atoi( str ) > 0 ? atoi( str ) : 24;
+		float ratio, lo, hi;
+		if ( hg_effectiveness( hg, time(0) - 3600 * hours, &ratio, &lo, &hi ) )
+		{
+			// When even the upper bound is below 100%, we are quite sure that some plots are not searched.
+			snprintf
+			(
+				q_ef, sizeof(q_ef), "EFFECTIVENESS:%d%%[%d-%d%s]",
+				(int) roundf( 100 * fminf( ratio, 9.99f ) ),
+				(int) roundf( 100 * fminf( lo, 9.99f ) ),
+				(int) roundf( 100 * fminf( hi, 9.99f ) ),
+				hi < 1.0f ? " LOW" : ""
+			);
+		}
+	}
+
+	char q_ag[24] = "";
+	if ( viewer_mode )
+		snprintf( q_ag, sizeof(q_ag), "AGENTS:%d/%d", viewer_num_connected(), viewer_num_agents() );
+
 	snprintf
 	(
 		overlay+0,
 		imw,
-		"PLOTS:%d  AVG-CHECK:%dms[%s]  SLOWEST-CHECK:%dms[%s]   ",
-		plotcount,
+		"PLOTS:%d%s  AVG-CHECK:%dms[%s]  SLOWEST-CHECK:%dms[%s]  %s  %s  %s  %s   ",
+		st->plots, q_pl,
 		avgms, q_av,
-		worstms, q_wo
+		worstms, q_wo,
+		q_ef,
+		q_sp,
+		q_ag,
+		q_al
 	);
 }
 
 
+// Returns the nr of graph columns that changed.
 static int update_image(void)
 {
 	int redraw=0;
 
-	if ( grapher_resized )
+	if ( grapher_resized && grapher_adapt_to_new_size() )
 	{
-		grapher_adapt_to_new_size();
 		setup_scale();
 		redraw=1;
+		render_invalid=1;
+	}
+	else if ( grapher_resized )
+		return 0;	// The terminal is still changing size. Drawing at the old size would be wasted.
+
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	if ( st.farmer_log != has_access_to_farmer_log )
+	{
+		// Now that we know of the farmer, the legend can show pool partials.
+		has_access_to_farmer_log = st.farmer_log;
+		setup_postscript();
 	}
 
 	// Compose the image.
-	if ( newest_stamp > refresh_stamp )
+	if ( st.newest_stamp > refresh_stamp )
 		redraw=1;
 
-	if ( time(0) > refresh_stamp )
+	if ( (int64_t) time(0) * 1000 > refresh_stamp )
 		redraw=1;
 
+	if ( render_invalid )
+		redraw=1;
+
+	int changedcols=0;
 	if (redraw)
 	{
 		time_t now = time(0);
+		// Only columns of quarters that got new entries need drawing, unless something changed for all of them.
+		const int all = render_invalid || st.plot_runs != drawnruns || st.oldest_stamp != drawnoldest || st.pool_proofs != drawnpool;
+		drawnruns = st.plot_runs;
+		drawnoldest = st.oldest_stamp;
+		drawnpool = st.pool_proofs;
+		// On a terminal that takes bitmaps, we draw the graph at its full pixel resolution.
+		uint32_t* graph = bitmap ? bitmap : im + (5*imw);
+		const int graphh = bitmap ? bitmaph : imh-6;
+		INSTR_BEGIN( t0 );
 		for ( int col=0; col<imw-2; ++col )
 		{
-			draw_column( col, im + (5*imw) + (imw-2-col), imh-6, now );
+			const int q = HG_NUM_COLUMNS-1-col;
+			if ( q < 0 )
+				continue;
+			time_t timelo;
+			const int sz = hg_column_entries( hg, col, &timelo );
+			if ( !all && q < HG_NUM_COLUMNS-1 && sz == drawnsz[q] && timelo == drawnlo[q] )
+				continue;	// The newest quarter is always drawn, as time moves on in it.
+			const int x = imw-2-col;
+			if ( hg_draw_column( hg, col, graph + x, imw, graphh, now, palettes + cmapnr ) )
+			{
+				grapher_column_changed( x );
+				changedcols++;
+			}
+			drawnsz[ q ] = sz;
+			drawnlo[ q ] = timelo;
+		}
+		INSTR_END( STAGE_DRAW, t0 );
+		place_stats_into_overlay( &st );
+		char* debugline = overlay + ( imh/2 - 1 ) * imw;
+		memset( debugline, 0, imw );
+		if ( show_debug )
+		{
+			sync_counters();
+			instr_format( debugline, imw );
+			const size_t n = strlen( debugline );
+			if ( n + 2 < (size_t) imw )
+			{
+				strcat( debugline, "  " );
+				hg_grammar_format( hg, debugline + n + 2, imw - n - 2 );
+			}
 		}
-		place_stats_into_overlay();
 		grapher_update();
-		refresh_stamp = newest_stamp;
+		refresh_stamp = st.newest_stamp;
+		render_invalid = 0;
 	}
-	return 0;
+	return changedcols;
 }
 
 
@@ -616,20 +777,20 @@ static void enableRawMode()
 }
 
 
-int main(int argc, char *argv[])
+static void usage( const char* prog )
 {
-	const char* dirname = 0;
+	fprintf( stderr, "Usage: %s ~/.chia/mainnet/log|-|/path/to/fifo\n", prog );
+	fprintf( stderr, "       %s export ~/.chia/mainnet/log history.csv|history.bin|- [from [to]]\n", prog );
+	fprintf( stderr, "       %s agent ~/.chia/mainnet/log host:port|/path/to/socket [name]\n", prog );
+	fprintf( stderr, "       %s viewer [host:]port|/path/to/socket\n", prog );
+	fprintf( stderr, "       %s render ~/.chia/mainnet/log graph.png|graph.ppm [WIDTHxHEIGHT [seconds]]\n", prog );
+	fprintf( stderr, "       %s report [~/.chia/mainnet/log|history.csv|history.bin|kept-days...] [json]\n", prog );
+	exit( 1 );
+}
 
-	if (argc != 2)
-	{
-		fprintf( stderr, "Usage: %s ~/.chia/mainnet/log\n", argv[0] );
-		exit( 1 );
-	}
-	else
-	{
-		dirname = argv[ 1 ];
-	}
 
+static void check_directory( const char* dirname )
+{
 	DIR* dir = opendir(dirname);
 	if ( !dir )
 	{
@@ -645,29 +806,35 @@ int main(int argc, char *argv[])
 		closedir(dir);
 		dir=0;
 	}
+}
 
-	fprintf( stderr, "Monitoring directory %s\n", dirname );
-
-	const int viridis = ( getenv( "CMAP_VIRIDIS" ) != 0 );
-	const int magma   = ( getenv( "CMAP_MAGMA"   ) != 0 );
-	const int plasma  = ( getenv( "CMAP_PLASMA"  ) != 0 );
-
-	ramp = cmap_heat;
-	if ( viridis ) ramp = cmap_viridis;
-	if ( magma   ) ramp = cmap_magma;
-	if ( plasma  ) ramp = cmap_plasma;
 
-	init_quarters( time(0) );
+// Accepts seconds since epoch, or a local time like 2021-05-30 or 2021-05-30T14:00 or 2021-05-30T14:00:00
+static time_t parse_time( const char* str )
+{
+	int year=-1, month=-1, day=-1, hours=0, minut=0, secon=0;
+	const int num = sscanf( str, "%04d-%02d-%02dT%02d:%02d:%02d", &year, &month, &day, &hours, &minut, &secon );
+	if ( num < 3 )
+		return (time_t) atoll( str );
+	struct tm tim =
+	{
+		secon,		// seconds 0..60
+		minut,		// minutes 0..59
+		hours,		// hours 0..23
+		day,		// day 1..31
+		month-1,	// month 0..11
+		year-1900,	// year - 1900
+		-1,
+		-1,
+		-1
+	};
+	return mktime( &tim );
+}
 
-	setup_postscript();
 
-	int numdebuglogs=8;
-	const char* str = getenv("NUM_DEBUG_LOGS");
-	if ( str )
-	{
-		numdebuglogs=atoi(str);
-		assert(numdebuglogs>0);
-	}
+static void read_all_logs( const char* dirname )
+{
+	const int numdebuglogs = num_debug_logs();
 	for ( int i=numdebuglogs-1; i>=0; --i )
 	{
 		char logfilename[80];
@@ -682,7 +849,279 @@ int main(int argc, char *argv[])
 			fprintf( stderr, "read %d lines from log %s\n", numl, logfilename );
 		}
 	}
+}
+
 
+static int export_main( int argc, char* argv[] )
+{
+	if ( argc < 4 || argc > 6 )
+		usage( argv[0] );
+	const char* dirname = argv[ 2 ];
+	const char* outname = argv[ 3 ];
+	const time_t from = argc > 4 ? parse_time( argv[ 4 ] ) : 0;
+	const time_t to   = argc > 5 ? parse_time( argv[ 5 ] ) : (time_t) LLONG_MAX;
+
+	const int streaming = open_log_stream( dirname, 0, 0 );
+	if ( !streaming )
+		check_directory( dirname );
+
+	setup_history();
+	alerts_init( &alerts );
+	if ( streaming )
+		drain_log_stream();
+	else
+		read_all_logs( dirname );
+	commit_all_entries();	// The newest entries are still held back, in case an older one comes in late.
+
+	const size_t len = strlen( outname );
+	const int binary = len > 4 && !strcmp( outname + len - 4, ".bin" );
+	FILE* f = strcmp( outname, "-" ) ? fopen( outname, "wb" ) : stdout;
+	if ( !f )
+		err( EXIT_FAILURE, "failed to open '%s' for writing", outname );
+	// Large writes, so that we are limited by the disk, not by the syscalls.
+	static char iobuf[ 1<<20 ];
+	setvbuf( f, iobuf, _IOFBF, sizeof(iobuf) );
+	const long nrows = hg_export( hg, f, binary, from, to );
+	if ( nrows < 0 || ( f != stdout && fclose( f ) ) )
+		err( EXIT_FAILURE, "failed to write '%s'", outname );
+	fprintf( stderr, "Exported %ld entries to %s\n", nrows, outname );
+	return 0;
+}
+
+
+static void format_day( char* s, size_t sz, int64_t start )
+{
+	const time_t t = (time_t) start;
+	struct tm tim;
+	localtime_r( &t, &tim );
+	strftime( s, sz, "%Y-%m-%d", &tim );
+}
+
+
+// Prints -1 as null.
+static void json_int( FILE* f, const char* key, int v, const char* sep )
+{
+	if ( v < 0 )
+		fprintf( f, "\"%s\": null%s", key, sep );
+	else
+		fprintf( f, "\"%s\": %d%s", key, v, sep );
+}
+
+
+static void json_day( FILE* f, const hg_day_t* d )
+{
+	char date[ 16 ];
+	format_day( date, sizeof(date), d->start );
+	fprintf( f, "{ \"date\": \"%s\", \"start\": %lld, ", date, (long long) d->start );
+	if ( d->quarters )
+		fprintf( f, "\"uptime\": %.4f, ", (double) d->up_quarters / d->quarters );
+	else
+		fprintf( f, "\"uptime\": null, " );
+	fprintf( f, "\"up_quarters\": %d, \"quarters\": %d, ", d->up_quarters, d->quarters );
+	fprintf( f, "\"checks\": %d, \"eligible\": %d, \"proofs\": %d, \"partials\": %d, ", d->checks, d->eligible, d->proofs, d->partials );
+	fprintf( f, "\"lookup_ms\": { " );
+	json_int( f, "p50", d->lookup_p50, ", " );
+	json_int( f, "p95", d->lookup_p95, ", " );
+	json_int( f, "p99", d->lookup_p99, ", " );
+	json_int( f, "max", d->lookup_max, " }, " );
+	fprintf( f, "\"plots\": { " );
+	json_int( f, "first", d->plots_first, ", " );
+	json_int( f, "last", d->plots_last, ", " );
+	json_int( f, "min", d->plots_min, ", " );
+	json_int( f, "max", d->plots_max, ", " );
+	fprintf( f, "\"changes\": %d, \"drops\": %d } }", d->plot_changes, d->plot_drops );
+}
+
+
+static void text_day( FILE* f, const char* label, const hg_day_t* d )
+{
+	char uptime[ 16 ] = "-";
+	if ( d->quarters )
+		snprintf( uptime, sizeof(uptime), "%.1f%%", 100.0 * d->up_quarters / d->quarters );
+	char lookup[ 48 ] = "-";
+	if ( d->lookup_p50 >= 0 )
+		snprintf( lookup, sizeof(lookup), "%d/%d/%d/%d", d->lookup_p50, d->lookup_p95, d->lookup_p99, d->lookup_max );
+	char plots[ 32 ] = "-";
+	if ( d->plots_last >= 0 && d->plots_min != d->plots_max )
+		snprintf( plots, sizeof(plots), "%d[%d-%d]", d->plots_last, d->plots_min, d->plots_max );
+	else if ( d->plots_last >= 0 )
+		snprintf( plots, sizeof(plots), "%d", d->plots_last );
+	fprintf
+	(
+		f, "%-10s %7s %8d %8d %6d %8d %20s %16s %7d %5d\n",
+		label, uptime, d->checks, d->eligible, d->proofs, d->partials, lookup, plots, d->plot_changes, d->plot_drops
+	);
+}
+
+
+static char daysname[ PATH_MAX ];	// Where we keep the daily totals.
+static time_t days_saved=0;
+static int days_saved_entries=0;
+static int days_failed=0;
+
+
+// With ROLLUP_FILE set, the daily totals are kept in that file, so that they go back further than the logs do, and a
+// report needs no logs. The file is for one harvester: entries that are not newer than the days in it, are skipped.
+static const char* days_file( void )
+{
+	const char* str = getenv( "ROLLUP_FILE" );
+	if ( !str || !str[ 0 ] )
+		return 0;
+	snprintf( daysname, sizeof(daysname), "%s", str );
+	return daysname;
+}
+
+
+// Picks up the days where we left them. Must come before the logs are read.
+static void load_days( void )
+{
+	const char* name = days_file();
+	FILE* f = name ? fopen( name, "rb" ) : 0;
+	if ( !f )
+		return;
+	if ( hg_load_days( hg, f, 0 ) < 0 )
+		errx( EXIT_FAILURE, "'%s' does not hold daily totals. Set ROLLUP_FILE to another file.", name );
+	fclose( f );
+}
+
+
+// Like the rendered image, the days go into a new file that replaces the old one, so that a reader never sees half of them.
+static void save_days( int force )
+{
+	const char* name = daysname[ 0 ] ? daysname : 0;
+	const time_t now = time(0);
+	if ( !name || ( !force && now - days_saved < DAYS_SAVE_SECS ) )
+		return;
+	days_saved = now;
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	if ( st.entries == days_saved_entries )
+		return;
+	char tmpname[ PATH_MAX + 16 ];
+	snprintf( tmpname, sizeof(tmpname), "%s.tmp%d", name, (int) getpid() );
+	FILE* f = fopen( tmpname, "wb" );
+	if ( !f )
+		return;
+	const int rv = hg_save_days( hg, f );
+	if ( fclose( f ) || rv || rename( tmpname, name ) )
+	{
+		unlink( tmpname );
+		if ( !days_failed++ )
+			fprintf( stderr, "Failed to write the daily totals to '%s'.\n", name );
+		return;
+	}
+	days_saved_entries = st.entries;
+}
+
+
+// Daily totals, from the logs, or from exported history, or without either, from the days that we keep.
+// Set REPORT_DAYS to only report the last so many days.
+static int report_main( int argc, char* argv[] )
+{
+	const int json = argc > 2 && !strcmp( argv[ argc-1 ], "json" );
+	const int numsources = argc - 2 - json;
+	const char* kept[ 1 ] = { numsources ? 0 : days_file() };
+	const char* const* sources = numsources ? (const char* const*) argv + 2 : kept;
+	if ( !sources[ 0 ] )
+		usage( argv[0] );
+	if ( !numsources && access( sources[ 0 ], R_OK ) )
+		err( EXIT_FAILURE, "no kept days in '%s'", sources[ 0 ] );
+
+	setup_history();
+	alerts_init( &alerts );
+	int fromlogs = 0;
+	int64_t last = 0;
+	for ( int i=0; i<( numsources ? numsources : 1 ); ++i )
+	{
+		const char* name = sources[ i ];
+		struct stat st;
+		if ( strcmp( name, "-" ) && !stat( name, &st ) && S_ISREG( st.st_mode ) )
+		{
+			// Exports that overlap are fine, as long as they are given oldest first. Kept days can only come first.
+			FILE* f = fopen( name, "rb" );
+			if ( !f )
+				err( EXIT_FAILURE, "failed to open '%s'", name );
+			const int numdays = i ? -1 : hg_load_days( hg, f, &last );
+			if ( numdays >= 0 )
+			{
+				fclose( f );
+				fprintf( stderr, "read %d days from %s\n", numdays, name );
+				continue;
+			}
+			rewind( f );
+			const long nrows = hg_import( hg, f, last, &last );
+			if ( nrows < 0 )
+				errx( EXIT_FAILURE, "'%s' is not a history that we exported, nor kept days that come first", name );
+			fclose( f );
+			fprintf( stderr, "read %ld entries from %s\n", nrows, name );
+			continue;
+		}
+		if ( fromlogs++ )
+			usage( argv[0] );	// The logs of one harvester are read once, but can be combined with exports.
+		if ( open_log_stream( name, 0, 0 ) )
+			drain_log_stream();
+		else
+		{
+			check_directory( name );
+			read_all_logs( name );
+		}
+		// An export that comes after the logs, only adds what is newer. One that came before, holds back what it had.
+		commit_all_entries();
+		hg_stats_t hs;
+		hg_stats( hg, &hs );
+		last = hs.newest_stamp > last ? hs.newest_stamp : last;
+	}
+
+	// For logs, quarters up to now count for the uptime. For an export, up to where it ends.
+	const time_t until = fromlogs ? time(0) : (time_t) ( last / 1000 );
+	const char* str = getenv( "REPORT_DAYS" );
+	const int maxdays = str && atoi( str ) > 0 ? atoi( str ) : HG_MAX_DAYS;
+	static hg_day_t days[ HG_MAX_DAYS ];
+	hg_day_t total;
+	const int n = hg_days( hg, days, maxdays, until, &total );
+
+	if ( json )
+	{
+		printf( "{\n\"days\": [\n" );
+		for ( int i=0; i<n; ++i )
+		{
+			json_day( stdout, days + i );
+			printf( "%s\n", i+1 < n ? "," : "" );
+		}
+		printf( "],\n\"total\": " );
+		json_day( stdout, &total );
+		printf( "\n}\n" );
+		return 0;
+	}
+	printf( "%-10s %7s %8s %8s %6s %8s %20s %16s %7s %5s\n", "DAY", "UPTIME", "CHECKS", "ELIGIBLE", "PROOFS", "PARTIALS", "LOOKUP-MS:50/95/99/MAX", "PLOTS", "CHANGES", "DROPS" );
+	for ( int i=0; i<n; ++i )
+	{
+		char date[ 16 ];
+		format_day( date, sizeof(date), days[ i ].start );
+		text_day( stdout, date, days + i );
+	}
+	if ( n )
+		text_day( stdout, "TOTAL", &total );
+	return 0;
+}
+
+
+static void setup_colours(void)
+{
+	const int viridis = ( getenv( "CMAP_VIRIDIS" ) != 0 );
+	const int magma   = ( getenv( "CMAP_MAGMA"   ) != 0 );
+	const int plasma  = ( getenv( "CMAP_PLASMA"  ) != 0 );
+
+	if ( viridis ) cmapnr = 1;
+	if ( magma   ) cmapnr = 2;
+	if ( plasma  ) cmapnr = 3;
+	ramp = cmaps[ cmapnr ];
+	setup_luts();
+}
+
+
+static int watch_directory( const char* dirname )
+{
 	int fd;
 	if ( (fd = inotify_init()) < 0 )
 		err( EXIT_FAILURE, "failed to initialize inotify instance" );
@@ -691,10 +1130,187 @@ int main(int argc, char *argv[])
 	fcntl( fd, F_SETFL, flags | O_NONBLOCK );
 
 	int wd;
-	if ( (wd = inotify_add_watch ( fd, dirname, IN_MODIFY | IN_CREATE | IN_DELETE ) ) < 0 )
+	if ( (wd = inotify_add_watch ( fd, dirname, IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO ) ) < 0 )
 		err( EXIT_FAILURE, "failed to add inotify watch for '%s'", dirname );
+	return fd;
+}
+
+
+// Reads notifications, and whatever got added to the log. Sleeps for idle_secs if nothing happened.
+static void service_log_directory( int fd, const char* dirname, unsigned int idle_secs )
+{
+	char buf[ sizeof(struct inotify_event) + PATH_MAX ];
+	const int len = read( fd, buf, sizeof(buf) );
+	if ( len <= 0 )
+	{
+		if ( errno == EWOULDBLOCK )
+		{
+			const int numl = read_log_file();
+			if ( !numl )
+			{
+				// In case we missed the notification.
+				follow_log_rotation( dirname );
+				if ( grapher_resized && im )
+				{
+					// Come back soon, to adapt once the terminal stops changing size.
+					const struct timespec nap = { 0, 50000000L };
+					nanosleep( &nap, 0 );
+				}
+				else
+					sleep( idle_secs );
+			}
+		}
+		else if ( errno != EINTR )
+			err( EXIT_FAILURE, "failed to read inotify event" );
+	}
+	int i=0;
+	while (i < len)
+	{
+		struct inotify_event *ie = (struct inotify_event*) &buf[i];
+		if ( ie->mask & ( IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO ) )
+		{
+			// Our log file got moved away, or a new one took its place.
+			if ( !strcmp( ie->name, "debug.log" ) )
+				follow_log_rotation( dirname );
+		}
+		else if ( ie->mask & IN_MODIFY )
+		{
+			// We used to only read on modify, but that would pause the graph.
+		}
+		else if (ie->mask & IN_DELETE)
+		{
+			// printf("%s was deleted\n",  ie->name);
+		}
+
+		i += sizeof(struct inotify_event) + ie->len;
+	}
+}
+
+
+static void service_log_input( int fd, const char* dirname, unsigned int idle_secs )
+{
+	if ( stream.fd >= 0 )
+		service_log_stream( idle_secs );
+	else
+		service_log_directory( fd, dirname, idle_secs );
+}
 
 
+// Returns 1 if the user wants to quit.
+static int handle_keys(void)
+{
+	char c=0;
+	const int numr = read( STDIN_FILENO, &c, 1 );
+	if ( numr == 1 && ( c == 'c' || c == 'C' ) )
+		cycle_colourmap();
+	if ( numr == 1 && ( c == 'd' || c == 'D' ) )
+	{
+		show_debug = !show_debug;
+		render_invalid = 1;
+	}
+
+	if ( instr_dump_requested )
+	{
+		instr_dump_requested = 0;
+		dump_counters();
+	}
+	return numr == 1 && ( c == 27 || c == 'q' || c == 'Q' );
+}
+
+
+// Other local tools can read our stats from shared memory. Set SHM_NAME=none to not publish.
+static void setup_publish(void)
+{
+	const char* name = getenv( "SHM_NAME" );
+	if ( name && !strcmp( name, "none" ) )
+		return;
+	publish_init( name ? name : PUBLISH_NAME );
+}
+
+
+static void publish_stats(void)
+{
+	publish_update( hg, alerts_num_firing( &alerts ) );
+}
+
+
+static int agent_main( int argc, char* argv[] )
+{
+	if ( argc < 4 || argc > 5 )
+		usage( argv[0] );
+	const char* dirname = argv[ 2 ];
+	const char* addr = argv[ 3 ];
+	char name[ 64 ];
+	if ( argc > 4 )
+		snprintf( name, sizeof(name), "%s", argv[ 4 ] );
+	else if ( gethostname( name, sizeof(name) ) )
+		snprintf( name, sizeof(name), "harvester" );
+	name[ sizeof(name)-1 ] = 0;
+
+	const int streaming = open_log_stream( dirname, 0, 1 );
+	if ( !streaming )
+		check_directory( dirname );
+
+	fprintf( stderr, "Shipping entries from %s to %s as '%s'\n", dirname, addr, name );
+
+	agent_mode = 1;
+	agent_init( addr, name );
+	setup_history();
+	load_days();
+	instr_init();
+	alerts_init( &alerts );
+	if ( !streaming )
+		read_all_logs( dirname );
+
+	const int fd = streaming ? -1 : watch_directory( dirname );
+	alerts_go_live( &alerts, time(0) );
+
+	while ( 1 )
+	{
+		service_log_input( fd, dirname, 1 );
+		agent_update();
+		alerts_tick( &alerts, time(0) );
+		save_days( 0 );
+		if ( instr_dump_requested )
+		{
+			instr_dump_requested = 0;
+			dump_counters();
+		}
+	}
+	return 0;
+}
+
+
+// Entries from all agents go into the one history, so the graph shows the farm as a whole.
+static void add_remote_record( const record_t* r, int agentnr )
+{
+	total_plots += r->plots - agent_plots[ agentnr ];
+	agent_plots[ agentnr ] = r->plots;
+	const hg_entry_t e = { r->t, r->eligi, r->proof, r->durat, r->plots };
+	hg_add_entry( hg, &e, total_plots );
+}
+
+
+static int viewer_main( int argc, char* argv[] )
+{
+	if ( argc != 3 )
+		usage( argv[0] );
+	const char* addr = argv[ 2 ];
+
+	viewer_mode = 1;
+	setup_colours();
+	setup_history();
+	instr_init();
+	alerts_init( &alerts );
+	setup_postscript();
+
+	if ( viewer_init( addr ) )
+		exit( 2 );
+	fprintf( stderr, "Waiting for agents on %s\n", addr );
+
+	setup_publish();
+	publish_stats();
+
 	int result = grapher_init();
 	if ( result < 0 )
 	{
@@ -703,61 +1319,169 @@ int main(int argc, char *argv[])
 	}
 
 	enableRawMode();
+	alerts_go_live( &alerts, time(0) );
 	update_image();
 
-	// Read notifications.
-	char buf[ sizeof(struct inotify_event) + PATH_MAX ];
 	int done=0;
-
 	do
 	{
-		const int len = read( fd, buf, sizeof(buf) );
-		if ( len <= 0 )
+		if ( viewer_update( 500, add_remote_record ) )
+			render_invalid = 1;	// Agents may have come or gone.
+		alerts_tick( &alerts, time(0) );
+		publish_stats();
+		update_image();
+		done = handle_keys();
+	} while (!done);
+
+	grapher_exit();
+	exit(0);
+}
+
+
+// Renders the graph into an image file, for dashboards. Needs no terminal.
+static int render_main( int argc, char* argv[] )
+{
+	if ( argc < 4 || argc > 6 )
+		usage( argv[0] );
+	const char* dirname = argv[ 2 ];
+	const char* outname = argv[ 3 ];
+	int w = HG_NUM_COLUMNS + 2;
+	int h = 240;
+	if ( argc > 4 && sscanf( argv[ 4 ], "%dx%d", &w, &h ) != 2 )
+		usage( argv[0] );
+	const int interval = argc > 5 ? atoi( argv[ 5 ] ) : 1;	// Zero means: render once, and exit.
+
+	const int streaming = open_log_stream( dirname, 0, interval > 0 );
+	if ( !streaming )
+		check_directory( dirname );
+
+	if ( grapher_init_headless( w, h ) )
+	{
+		fprintf( stderr, "Image size %dx%d is not supported.\n", w, h );
+		exit(2);
+	}
+
+	setup_colours();
+	setup_history();
+	load_days();
+	instr_init();
+	alerts_init( &alerts );
+	setup_postscript();
+	if ( !streaming )
+		read_all_logs( dirname );
+	else if ( interval <= 0 )
+		drain_log_stream();
+
+	const int fd = interval > 0 && !streaming ? watch_directory( dirname ) : -1;
+	alerts_go_live( &alerts, time(0) );
+
+	time_t last_render = 0;
+	while ( 1 )
+	{
+		const time_t now = time(0);
+		if ( now - last_render >= interval )
 		{
-			if ( errno == EWOULDBLOCK )
-			{
-				const int numl = read_log_file();
-				if ( !numl )
-					sleep(6);
-			}
-			else if ( errno != EINTR )
-				err( EXIT_FAILURE, "failed to read inotify event" );
+			last_render = now;
+			// Only encode when the graph changed. Most of the time, nothing did.
+			if ( update_image() && imgwrite_save( outname, imw, imh, im ) )
+				err( EXIT_FAILURE, "failed to write '%s'", outname );
 		}
-		int i=0;
-		while (i < len)
+		if ( interval <= 0 )
+			break;
+		service_log_input( fd, dirname, 1 );
+		alerts_tick( &alerts, time(0) );
+		save_days( 0 );
+		if ( instr_dump_requested )
 		{
-			struct inotify_event *ie = (struct inotify_event*) &buf[i];
-			if ( ie->mask & IN_CREATE )
-			{
-				// A file got created. It could be our new log file!
-				if ( !strcmp( ie->name, "debug.log" ) )
-				{
-					fprintf( stderr, "Reopening logfile.\n" );
-					open_log_file( dirname, 0 );
-					const int numl = read_log_file();
-					fprintf( stderr, "read %d lines from log.\n", numl );
-				}
-			}
-			else if ( ie->mask & IN_MODIFY )
-			{
-				// We used to only read on modify, but that would pause the graph.
-			}
-			else if (ie->mask & IN_DELETE)
-			{
-				// printf("%s was deleted\n",  ie->name);
-			}
-
-			i += sizeof(struct inotify_event) + ie->len;
+			instr_dump_requested = 0;
+			dump_counters();
 		}
+	}
+	save_days( 1 );
+	grapher_exit();
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char* dirname = 0;
+
+	if ( argc >= 2 && !strcmp( argv[ 1 ], "export" ) )
+		return export_main( argc, argv );
+
+	if ( argc >= 2 && !strcmp( argv[ 1 ], "agent" ) )
+		return agent_main( argc, argv );
+
+	if ( argc >= 2 && !strcmp( argv[ 1 ], "viewer" ) )
+		return viewer_main( argc, argv );
+
+	if ( argc >= 2 && !strcmp( argv[ 1 ], "render" ) )
+		return render_main( argc, argv );
+
+	if ( argc >= 2 && !strcmp( argv[ 1 ], "report" ) )
+		return report_main( argc, argv );
+
+	if (argc != 2)
+		usage( argv[0] );
+	else
+		dirname = argv[ 1 ];
+
+	const int streaming = open_log_stream( dirname, 1, 1 );
+	if ( !streaming )
+		check_directory( dirname );
+
+	fprintf( stderr, "Monitoring %s %s\n", streaming ? "log stream" : "directory", dirname );
+
+	setup_colours();
+
+	setup_history();
+
+	load_days();
+
+	instr_init();
+
+	alerts_init( &alerts );
+
+	setup_postscript();
+
+	if ( !streaming )
+		read_all_logs( dirname );
+
+	setup_publish();
+	publish_stats();
+
+	const int fd = streaming ? -1 : watch_directory( dirname );
+
+	int result = grapher_init();
+	if ( result < 0 )
+	{
+		fprintf( stderr, "Failed to intialize grapher(), maybe we are not running in a terminal?\n" );
+		exit(2);
+	}
+
+	enableRawMode();
+	alerts_go_live( &alerts, time(0) );
+	update_image();
+
+	int done=0;
+
+	do
+	{
+		service_log_input( fd, dirname, 6 );
+
+		alerts_tick( &alerts, time(0) );
+
+		publish_stats();
+
+		save_days( 0 );
 
 		update_image();
 
-		char c=0;
-		const int numr = read( STDIN_FILENO, &c, 1 );
-		if ( numr == 1 && ( c == 27 || c == 'q' || c == 'Q' ) )
-			done=1;
+		done = handle_keys();
 	} while (!done);
 
+	save_days( 1 );
 	grapher_exit();
 	exit(0);
 }
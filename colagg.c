@@ -0,0 +1,288 @@
+// colagg.c
+//
+// by Abraham Stolk.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "colagg.h"
+
+#if ( defined(__x86_64__) || defined(__i386__) ) && defined(__GNUC__)
+#	define COLAGG_X86
+#	include <immintrin.h>
+#endif
+
+#define BLOCK	256	// Entries that we find the rows of, before we scatter them.
+
+// Finds the rows of n entries: -1 for an entry that is outside of the quarter.
+typedef void (*rows_fn)( int* rowof, const int64_t* stamps, int n, int64_t qlo, int h );
+
+// Turns the entries per row into their prefix sum, and takes the checks of the windows from it.
+typedef void (*windows_fn)( colagg_t* ca );
+
+
+void colagg_init( colagg_t* ca )
+{
+	memset( ca, 0, sizeof(colagg_t) );
+}
+
+
+void colagg_free( colagg_t* ca )
+{
+	free( ca->binoff );
+	colagg_init( ca );
+}
+
+
+int colagg_setup( colagg_t* ca, int h )
+{
+	if ( h+1 > ca->cap )
+	{
+		// All the arrays share a single allocation.
+		const int cap = 2 * (h+1);
+		int* mem = (int*) realloc( ca->binoff, 8 * (size_t) cap * sizeof(int) );
+		if ( !mem )
+			return -1;
+		ca->cap = cap;
+		ca->binoff = mem;
+		ca->wy0    = mem + 1 * cap;
+		ca->wy1    = mem + 2 * cap;
+		ca->rows   = mem + 3 * cap;
+		ca->checks = mem + 4 * cap;
+		ca->eligib = mem + 5 * cap;
+		ca->proofs = mem + 6 * cap;
+		ca->poolpr = mem + 7 * cap;
+	}
+	for ( int y=0; y<=h; ++y )
+		ca->binoff[ y ] = (int) ( (int64_t) COLAGG_SPAN * y / h );
+	// With many pixel rows per quarter, we average over more of them.
+	const int k = h < 128 ? 1 : h / 64;
+	for ( int y=0; y<h; ++y )
+	{
+		ca->wy0[ y ] = y-k > 0 ? y-k : 0;
+		ca->wy1[ y ] = y+k+1 < h ? y+k+1 : h;
+	}
+	ca->h = h;
+	return 0;
+}
+
+
+void colagg_reference( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo )
+{
+	const int* binoff = ca->binoff;
+	for ( int y=0; y<ca->h; ++y )
+	{
+		const int64_t r0 = qlo + binoff[ ca->wy0[ y ] ];
+		const int64_t r1 = qlo + binoff[ ca->wy1[ y ] ];
+		const int64_t s0 = qlo + binoff[ y+0 ];
+		const int64_t s1 = qlo + binoff[ y+1 ];
+		int checks=0;
+		int eli=0;
+		int pro=0;
+		int poo=0;
+		for ( int i=0; i<sz; ++i )
+		{
+			const int64_t t = stamps[ i ];
+			if ( t >= r0 && t < r1 )
+				checks++;
+			if ( t >= s0 && t < s1 )
+			{
+				eli += eligib[ i ];
+				pro += proofs[ i ];
+				poo += poolpr[ i ];
+			}
+		}
+		ca->checks[ y ] = checks;
+		ca->eligib[ y ] = eli;
+		ca->proofs[ y ] = pro;
+		ca->poolpr[ y ] = poo;
+	}
+}
+
+
+// Row y starts at floor(SPAN*y/h) so the last row that starts at or before d, is floor(((d+1)*h-1)/SPAN).
+static int row_of( int64_t t, int64_t qlo, int h )
+{
+	const int64_t d = t - qlo;
+	if ( d < 0 || d >= COLAGG_SPAN )
+		return -1;
+	return (int) ( ( ( d + 1 ) * h - 1 ) / COLAGG_SPAN );
+}
+
+
+static void rows_scalar( int* rowof, const int64_t* stamps, int n, int64_t qlo, int h )
+{
+	for ( int i=0; i<n; ++i )
+		rowof[ i ] = row_of( stamps[ i ], qlo, h );
+}
+
+
+static void windows_scalar( colagg_t* ca )
+{
+	int* rows = ca->rows;
+	for ( int y=0; y<ca->h; ++y )
+		rows[ y+1 ] += rows[ y ];
+	for ( int y=0; y<ca->h; ++y )
+		ca->checks[ y ] = rows[ ca->wy1[ y ] ] - rows[ ca->wy0[ y ] ];
+}
+
+
+// Scatters the entries into their rows, and gets the checks of each window from the prefix sum of the rows.
+static void aggregate( colagg_t* ca, rows_fn find_rows, windows_fn windows, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo )
+{
+	const int h = ca->h;
+	int* rows = ca->rows;
+	memset( rows,       0, ( h+1 ) * sizeof(int) );
+	memset( ca->eligib, 0, h * sizeof(int) );
+	memset( ca->proofs, 0, h * sizeof(int) );
+	memset( ca->poolpr, 0, h * sizeof(int) );
+	int rowof[ BLOCK ];
+	for ( int i0=0; i0<sz; i0+=BLOCK )
+	{
+		const int n = sz-i0 < BLOCK ? sz-i0 : BLOCK;
+		find_rows( rowof, stamps + i0, n, qlo, h );
+		for ( int i=0; i<n; ++i )
+		{
+			const int y = rowof[ i ];
+			if ( y < 0 )
+				continue;
+			rows[ y+1 ] += 1;
+			ca->eligib[ y ] += eligib[ i0+i ];
+			ca->proofs[ y ] += proofs[ i0+i ];
+			ca->poolpr[ y ] += poolpr[ i0+i ];
+		}
+	}
+	windows( ca );
+}
+
+
+static void colagg_scalar( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo )
+{
+	aggregate( ca, rows_scalar, windows_scalar, stamps, eligib, proofs, poolpr, sz, qlo );
+}
+
+
+#if defined(COLAGG_X86)
+
+// The divisions are done in double precision: (d+1)*h-1 is exact, and a correctly rounded quotient that is not a whole
+// number, stays below the next whole number, as it is at least 1/SPAN away from it. So truncating it gives the row.
+// Stamps outside of the quarter are masked to -1 with 64-bit compares, which need SSE4.2.
+
+__attribute__((target("sse4.2")))
+static void rows_sse42( int* rowof, const int64_t* stamps, int n, int64_t qlo, int h )
+{
+	const __m128i below = _mm_set1_epi64x( qlo - 1 );
+	const __m128i end   = _mm_set1_epi64x( qlo + COLAGG_SPAN );
+	const __m128d hd    = _mm_set1_pd( h );
+	const __m128d one   = _mm_set1_pd( 1.0 );
+	const __m128d span  = _mm_set1_pd( COLAGG_SPAN );
+	int i = 0;
+	for ( ; i+2<=n; i+=2 )
+	{
+		const __m128i t  = _mm_loadu_si128( (const __m128i*) ( stamps + i ) );
+		const __m128i in = _mm_and_si128( _mm_cmpgt_epi64( t, below ), _mm_cmpgt_epi64( end, t ) );
+		const __m128i d1 = _mm_shuffle_epi32( _mm_sub_epi64( t, below ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+		const __m128d q  = _mm_div_pd( _mm_sub_pd( _mm_mul_pd( _mm_cvtepi32_pd( d1 ), hd ), one ), span );
+		const __m128i y  = _mm_or_si128( _mm_cvttpd_epi32( q ), _mm_xor_si128( _mm_shuffle_epi32( in, _MM_SHUFFLE( 2, 0, 2, 0 ) ), _mm_set1_epi32( -1 ) ) );
+		_mm_storel_epi64( (__m128i*) ( rowof + i ), y );
+	}
+	for ( ; i<n; ++i )
+		rowof[ i ] = row_of( stamps[ i ], qlo, h );
+}
+
+
+__attribute__((target("avx2")))
+static void rows_avx2( int* rowof, const int64_t* stamps, int n, int64_t qlo, int h )
+{
+	const __m256i below = _mm256_set1_epi64x( qlo - 1 );
+	const __m256i end   = _mm256_set1_epi64x( qlo + COLAGG_SPAN );
+	const __m256i lows  = _mm256_setr_epi32( 0, 2, 4, 6, 0, 2, 4, 6 );
+	const __m256d hd    = _mm256_set1_pd( h );
+	const __m256d one   = _mm256_set1_pd( 1.0 );
+	const __m256d span  = _mm256_set1_pd( COLAGG_SPAN );
+	int i = 0;
+	for ( ; i+4<=n; i+=4 )
+	{
+		const __m256i t  = _mm256_loadu_si256( (const __m256i*) ( stamps + i ) );
+		const __m256i in = _mm256_and_si256( _mm256_cmpgt_epi64( t, below ), _mm256_cmpgt_epi64( end, t ) );
+		const __m128i d1 = _mm256_castsi256_si128( _mm256_permutevar8x32_epi32( _mm256_sub_epi64( t, below ), lows ) );
+		const __m128i m  = _mm256_castsi256_si128( _mm256_permutevar8x32_epi32( in, lows ) );
+		const __m256d q  = _mm256_div_pd( _mm256_sub_pd( _mm256_mul_pd( _mm256_cvtepi32_pd( d1 ), hd ), one ), span );
+		const __m128i y  = _mm_or_si128( _mm256_cvttpd_epi32( q ), _mm_xor_si128( m, _mm_set1_epi32( -1 ) ) );
+		_mm_storeu_si128( (__m128i*) ( rowof + i ), y );
+	}
+	for ( ; i<n; ++i )
+		rowof[ i ] = row_of( stamps[ i ], qlo, h );
+}
+
+
+// The prefix sum goes 8 rows at a time, and the windows are gathered.
+__attribute__((target("avx2")))
+static void windows_avx2( colagg_t* ca )
+{
+	int* rows = ca->rows + 1;
+	const int h = ca->h;
+	__m256i carry = _mm256_setzero_si256();
+	int y = 0;
+	for ( ; y+8<=h; y+=8 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*) ( rows + y ) );
+		v = _mm256_add_epi32( v, _mm256_slli_si256( v, 4 ) );
+		v = _mm256_add_epi32( v, _mm256_slli_si256( v, 8 ) );
+		v = _mm256_add_epi32( v, _mm256_permute2x128_si256( _mm256_setzero_si256(), _mm256_shuffle_epi32( v, _MM_SHUFFLE( 3, 3, 3, 3 ) ), 0x20 ) );
+		v = _mm256_add_epi32( v, carry );
+		_mm256_storeu_si256( (__m256i*) ( rows + y ), v );
+		carry = _mm256_permutevar8x32_epi32( v, _mm256_set1_epi32( 7 ) );
+	}
+	for ( ; y<h; ++y )
+		rows[ y ] += rows[ y-1 ];
+	rows = ca->rows;
+	for ( y=0; y+8<=h; y+=8 )
+	{
+		const __m256i hi = _mm256_i32gather_epi32( rows, _mm256_loadu_si256( (const __m256i*) ( ca->wy1 + y ) ), 4 );
+		const __m256i lo = _mm256_i32gather_epi32( rows, _mm256_loadu_si256( (const __m256i*) ( ca->wy0 + y ) ), 4 );
+		_mm256_storeu_si256( (__m256i*) ( ca->checks + y ), _mm256_sub_epi32( hi, lo ) );
+	}
+	for ( ; y<h; ++y )
+		ca->checks[ y ] = rows[ ca->wy1[ y ] ] - rows[ ca->wy0[ y ] ];
+}
+
+
+static void colagg_sse42( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo )
+{
+	aggregate( ca, rows_sse42, windows_scalar, stamps, eligib, proofs, poolpr, sz, qlo );
+}
+
+
+static void colagg_avx2( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo )
+{
+	aggregate( ca, rows_avx2, windows_avx2, stamps, eligib, proofs, poolpr, sz, qlo );
+}
+
+#endif
+
+
+int colagg_kernels( colagg_kernel_t* kernels )
+{
+	int n = 0;
+	kernels[ n++ ] = (colagg_kernel_t) { "reference", colagg_reference };
+	kernels[ n++ ] = (colagg_kernel_t) { "scalar", colagg_scalar };
+#if defined(COLAGG_X86)
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse4.2" ) )
+		kernels[ n++ ] = (colagg_kernel_t) { "sse4.2", colagg_sse42 };
+	if ( __builtin_cpu_supports( "avx2" ) )
+		kernels[ n++ ] = (colagg_kernel_t) { "avx2", colagg_avx2 };
+#endif
+	return n;
+}
+
+
+colagg_fn colagg_best( void )
+{
+	colagg_kernel_t kernels[ COLAGG_MAXKERNELS ];
+	const int n = colagg_kernels( kernels );
+	return kernels[ n-1 ].fn;
+}
+
@@ -0,0 +1,55 @@
+// colagg.h
+//
+// by Abraham Stolk.
+
+// Column aggregation: adds up the entries of a quarter-hour per pixel row of its column in the graph.
+//
+// Row y covers [binoff[y],binoff[y+1]) ms into the quarter. Its checks are counted over the wider window of rows
+// [wy0[y],wy1[y]), so that the colour does not flicker between checks, its eligible plots, proofs and partials are not.
+//
+// The reference kernel tests every entry against every row. The others find the row of each entry with a division,
+// scatter the entry into its row, and take the windows from a prefix sum, which makes them linear in entries plus rows.
+// The SSE4.2 and AVX2 kernels do the divisions 2 or 4 at a time, and the AVX2 kernel also does the prefix sum and gathers
+// the windows 8 rows at a time. All kernels give the same counts, to the bit.
+
+#define COLAGG_SPAN		900000	// A quarter-hour, in ms.
+#define COLAGG_MAXKERNELS	4
+
+typedef struct colagg
+{
+	int		h;		// Nr of pixel rows that the bins are for.
+	int		cap;
+	int*		binoff;		// Start of each pixel row, in ms since the start of the quarter. binoff[h] is the end.
+	int*		wy0;		// The window of rows that we count the checks of a row in.
+	int*		wy1;
+	int*		rows;		// Prefix sum of the entries per row: rows[y] entries come before row y.
+	int*		checks;		// The results, per row.
+	int*		eligib;
+	int*		proofs;
+	int*		poolpr;
+} colagg_t;
+
+typedef void (*colagg_fn)( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo );
+
+typedef struct colagg_kernel
+{
+	const char*	name;
+	colagg_fn	fn;
+} colagg_kernel_t;
+
+
+extern void colagg_init( colagg_t* ca );
+
+extern void colagg_free( colagg_t* ca );
+
+// Sets up the bins for h rows. Returns -1 if out of memory.
+extern int  colagg_setup( colagg_t* ca, int h );
+
+extern void colagg_reference( colagg_t* ca, const int64_t* stamps, const int* eligib, const int* proofs, const int* poolpr, int sz, int64_t qlo );
+
+// The kernels that this cpu can run, reference first, and fastest last. Returns how many.
+extern int  colagg_kernels( colagg_kernel_t* kernels );
+
+// The fastest kernel that this cpu can run.
+extern colagg_fn colagg_best( void );
+
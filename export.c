@@ -0,0 +1,331 @@
+// export.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "quarters.h"
+#include "export.h"
+
+
+#define NUMCOLS		6
+#define COLDESCSZ	24
+#define HEADERSZ	( 24 + NUMCOLS * COLDESCSZ )
+#define SECONDS_BEFORE	1e11	// CSV stamps below this are in seconds, as version 1 wrote them.
+
+enum { COL_I64=1, COL_I32=2, COL_F32=3 };
+
+static const char* colnames[ NUMCOLS ] = { "stamps", "eligib", "proofs", "poolpr", "durati", "plots" };
+static const int   coltypes[ NUMCOLS ] = { COL_I64,  COL_I32,  COL_I32,  COL_I32,  COL_F32,  COL_I32 };
+static const int   colsizes[ NUMCOLS ] = { 8,        4,        4,        4,        4,        4       };
+
+
+// Index of first entry in quarter q with a stamp at or after t.
+static int lower_bound( const quarterhr_t* q, stamp_t t )
+{
+	int lo = 0;
+	int hi = q->sz;
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( q->stamps[ mid ] < t )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static int host_is_little_endian( void )
+{
+	const uint16_t one = 1;
+	return *(const uint8_t*) &one;
+}
+
+
+static void put_le( uint8_t* dst, uint64_t v, int sz )
+{
+	for ( int i=0; i<sz; ++i )
+		dst[ i ] = (uint8_t) ( v >> ( 8*i ) );
+}
+
+
+static const void* column_data( const quarterhr_t* q, int col )
+{
+	switch( col )
+	{
+		case 0: return q->stamps;
+		case 1: return q->eligib;
+		case 2: return q->proofs;
+		case 3: return q->poolpr;
+		case 4: return q->durati;
+		default: return q->plots;
+	}
+}
+
+
+// Writes entries [i0,i1) of one column of a quarter.
+// When the in-memory layout already matches the file layout, it is written straight from the history, without a copy.
+static void write_column_slice( FILE* f, const quarterhr_t* q, int col, int i0, int i1 )
+{
+	const int n = i1 - i0;
+	if ( n <= 0 )
+		return;
+	if ( host_is_little_endian() )
+	{
+		const uint8_t* src = (const uint8_t*) column_data( q, col );
+		const size_t esz = colsizes[ col ];
+		fwrite( src + i0 * esz, esz, n, f );
+		return;
+	}
+	uint8_t buf[ 8 * MAXENTR ];
+	for ( int i=i0; i<i1; ++i )
+	{
+		uint8_t* dst = buf + ( i - i0 ) * colsizes[ col ];
+		uint32_t bits;
+		switch( col )
+		{
+			case 0: put_le( dst, (uint64_t) q->stamps[ i ], 8 ); break;
+			case 1: put_le( dst, (uint32_t) q->eligib[ i ], 4 ); break;
+			case 2: put_le( dst, (uint32_t) q->proofs[ i ], 4 ); break;
+			case 3: put_le( dst, (uint32_t) q->poolpr[ i ], 4 ); break;
+			case 4:
+				memcpy( &bits, q->durati + i, 4 );
+				put_le( dst, bits, 4 );
+				break;
+			default: put_le( dst, (uint32_t) q->plots[ i ], 4 );
+		}
+	}
+	fwrite( buf, colsizes[ col ], n, f );
+}
+
+
+static long count_rows( const quarterhr_t* quarters, stamp_t from, stamp_t to )
+{
+	long n = 0;
+	for ( int s=0; s<MAXHIST; ++s )
+		if ( quarters[ s ].timehi * 1000 > from && quarters[ s ].timelo * 1000 < to )
+			n += lower_bound( quarters+s, to ) - lower_bound( quarters+s, from );
+	return n;
+}
+
+
+static long export_bin( const quarterhr_t* quarters, FILE* f, stamp_t from, stamp_t to )
+{
+	const long nrows = count_rows( quarters, from, to );
+
+	uint8_t hdr[ HEADERSZ ];
+	memset( hdr, 0, sizeof(hdr) );
+	memcpy( hdr, "CHGCOL1", 8 );
+	put_le( hdr +  8, 3, 4 );
+	put_le( hdr + 12, NUMCOLS, 4 );
+	put_le( hdr + 16, (uint64_t) nrows, 8 );
+	uint64_t offset = HEADERSZ;
+	for ( int col=0; col<NUMCOLS; ++col )
+	{
+		uint8_t* desc = hdr + 24 + col * COLDESCSZ;
+		strncpy( (char*) desc, colnames[ col ], 8 );
+		put_le( desc +  8, coltypes[ col ], 4 );
+		put_le( desc + 12, colsizes[ col ], 4 );
+		put_le( desc + 16, offset, 8 );
+		offset += ( nrows * colsizes[ col ] + 7 ) & ~7ULL;
+	}
+	fwrite( hdr, sizeof(hdr), 1, f );
+
+	static const uint8_t pad[ 8 ];
+	for ( int col=0; col<NUMCOLS; ++col )
+	{
+		for ( int s=0; s<MAXHIST; ++s )
+		{
+			const quarterhr_t* q = quarters + s;
+			if ( q->timehi * 1000 <= from || q->timelo * 1000 >= to )
+				continue;
+			write_column_slice( f, q, col, lower_bound( q, from ), lower_bound( q, to ) );
+		}
+		const size_t padding = ( 8 - ( nrows * colsizes[ col ] ) % 8 ) % 8;
+		fwrite( pad, 1, padding, f );
+	}
+	return nrows;
+}
+
+
+static long export_csv( const quarterhr_t* quarters, FILE* f, stamp_t from, stamp_t to )
+{
+	long nrows = 0;
+	fprintf( f, "%s,%s,%s,%s,%s,%s\n", colnames[0], colnames[1], colnames[2], colnames[3], colnames[4], colnames[5] );
+	for ( int s=0; s<MAXHIST; ++s )
+	{
+		const quarterhr_t* q = quarters + s;
+		if ( q->timehi * 1000 <= from || q->timelo * 1000 >= to )
+			continue;
+		const int i1 = lower_bound( q, to );
+		for ( int i=lower_bound( q, from ); i<i1; ++i )
+		{
+			fprintf( f, "%lld,%d,%d,%d,%.5f,%d\n", (long long) q->stamps[i], q->eligib[i], q->proofs[i], q->poolpr[i], q->durati[i], q->plots[i] );
+			nrows++;
+		}
+	}
+	return nrows;
+}
+
+
+long export_history( const quarterhr_t* quarters, FILE* f, int format, time_t from, time_t to )
+{
+	// Clamp, so that the conversion to milliseconds can not overflow.
+	const stamp_t lo = from < 0 ? 0 : (stamp_t) from * 1000;
+	const stamp_t hi = to > INT64_MAX / 1000 ? INT64_MAX : (stamp_t) to * 1000;
+	const long nrows = format == EXPORT_BIN ? export_bin( quarters, f, lo, hi ) : export_csv( quarters, f, lo, hi );
+	if ( fflush( f ) )
+		return -1;
+	return ferror( f ) ? -1 : nrows;
+}
+
+
+
+static uint64_t get_le( const uint8_t* src, int sz )
+{
+	uint64_t v = 0;
+	for ( int i=0; i<sz; ++i )
+		v |= (uint64_t) src[ i ] << ( 8*i );
+	return v;
+}
+
+
+static int column_nr( const char* name, size_t len )
+{
+	for ( int col=0; col<NUMCOLS; ++col )
+		if ( strlen( colnames[ col ] ) == len && !strncmp( colnames[ col ], name, len ) )
+			return col;
+	return -1;
+}
+
+
+// Loads the columns that we know, by name. Files of version 2 have no plots column.
+static int load_columns( FILE* f, int ncols, uint64_t nrows, uint8_t** data )
+{
+	for ( int c=0; c<ncols; ++c )
+	{
+		uint8_t desc[ COLDESCSZ ];
+		if ( fseek( f, 24 + c * COLDESCSZ, SEEK_SET ) || fread( desc, sizeof(desc), 1, f ) != 1 )
+			return -1;
+		const int col = column_nr( (const char*) desc, strnlen( (const char*) desc, 8 ) );
+		if ( col < 0 || data[ col ] || get_le( desc + 8, 4 ) != (uint64_t) coltypes[ col ] || get_le( desc + 12, 4 ) != (uint64_t) colsizes[ col ] )
+			continue;
+		data[ col ] = (uint8_t*) malloc( nrows * colsizes[ col ] + 1 );
+		if ( !data[ col ] )
+			return -1;
+		if ( fseek( f, (long) get_le( desc + 16, 8 ), SEEK_SET ) || fread( data[ col ], colsizes[ col ], nrows, f ) != nrows )
+			return -1;
+	}
+	for ( int col=0; col<NUMCOLS-1; ++col )
+		if ( !data[ col ] )
+			return -1;
+	return 0;
+}
+
+
+static long import_bin( FILE* f, import_fn fn, void* user )
+{
+	uint8_t hdr[ 24 ];
+	if ( fread( hdr, sizeof(hdr), 1, f ) != 1 )
+		return -1;
+	const int version = (int) get_le( hdr + 8, 4 );
+	const int ncols = (int) get_le( hdr + 12, 4 );
+	const uint64_t nrows = get_le( hdr + 16, 8 );
+	if ( version < 1 || ncols < NUMCOLS-1 || ncols > 64 || nrows > ( 1ULL << 32 ) )
+		return -1;
+
+	uint8_t* data[ NUMCOLS ] = { 0 };
+	const int loaded = load_columns( f, ncols, nrows, data ) == 0;
+	for ( uint64_t i=0; loaded && i<nrows; ++i )
+	{
+		const stamp_t t = (stamp_t) get_le( data[ 0 ] + 8 * i, 8 );
+		const uint32_t bits = (uint32_t) get_le( data[ 4 ] + 4 * i, 4 );
+		float durat;
+		memcpy( &durat, &bits, 4 );
+		fn
+		(
+			user,
+			version < 2 ? t * 1000 : t,
+			(int32_t) get_le( data[ 1 ] + 4 * i, 4 ),
+			(int32_t) get_le( data[ 2 ] + 4 * i, 4 ),
+			(int32_t) get_le( data[ 3 ] + 4 * i, 4 ),
+			durat,
+			data[ 5 ] ? (int32_t) get_le( data[ 5 ] + 4 * i, 4 ) : 0
+		);
+	}
+	for ( int col=0; col<NUMCOLS; ++col )
+		free( data[ col ] );
+	return loaded ? (long) nrows : -1;
+}
+
+
+// Which of our columns each field of the CSV header is, or -1. Returns the nr of fields, or -1 if columns are missing.
+static int parse_csv_header( const char* line, int* order, int max )
+{
+	int nfields = 0;
+	int have = 0;
+	for ( const char* p = line; *p && nfields < max; )
+	{
+		const size_t len = strcspn( p, ",\r\n" );
+		const int col = column_nr( p, len );
+		order[ nfields++ ] = col;
+		have |= col >= 0 ? 1 << col : 0;
+		p += len;
+		if ( *p != ',' )
+			break;
+		p++;
+	}
+	const int needed = ( 1 << ( NUMCOLS-1 ) ) - 1;
+	return ( have & needed ) == needed ? nfields : -1;
+}
+
+
+static long import_csv( FILE* f, import_fn fn, void* user )
+{
+	char* line = 0;
+	size_t linesz = 0;
+	int order[ 16 ];
+	const int nfields = getline( &line, &linesz, f ) > 0 ? parse_csv_header( line, order, 16 ) : -1;
+	long nrows = nfields < 0 ? -1 : 0;
+	while ( nfields > 0 && getline( &line, &linesz, f ) > 0 )
+	{
+		double v[ NUMCOLS ] = { 0 };
+		const char* p = line;
+		int k = 0;
+		for ( k=0; k<nfields; ++k )
+		{
+			char* end;
+			const double x = strtod( p, &end );
+			if ( end == p )
+				break;
+			if ( order[ k ] >= 0 )
+				v[ order[ k ] ] = x;
+			p = end + ( *end == ',' );
+		}
+		if ( k < nfields )
+			continue;	// Not a complete row.
+		// Version 1 has the same header, so only the size of the stamp tells: in ms, it would be 1973 or before.
+		if ( v[ 0 ] < SECONDS_BEFORE )
+			v[ 0 ] *= 1000;
+		fn( user, (stamp_t) v[ 0 ], (int) v[ 1 ], (int) v[ 2 ], (int) v[ 3 ], (float) v[ 4 ], (int) v[ 5 ] );
+		nrows++;
+	}
+	free( line );
+	return nrows;
+}
+
+
+long import_history( FILE* f, import_fn fn, void* user )
+{
+	char magic[ 8 ];
+	const int isbin = fread( magic, sizeof(magic), 1, f ) == 1 && !memcmp( magic, "CHGCOL1", 8 );
+	if ( fseek( f, 0, SEEK_SET ) )
+		return -1;
+	return isbin ? import_bin( f, fn, user ) : import_csv( f, fn, user );
+}
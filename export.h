@@ -0,0 +1,32 @@
+// export.h
+//
+// by Abraham Stolk.
+
+// Streams the harvest history in quarters[] to a file, for offline analysis, and reads it back.
+//
+// The binary format is little-endian, and laid out in columns so that it loads straight into numpy:
+//
+//	offset	size	field
+//	0	8	magic "CHGCOL1\0"
+//	8	4	version (3)
+//	12	4	number of columns
+//	16	8	number of rows
+//	24	24*n	column descriptors: name[8], type (1=int64, 2=int32, 3=float32), element size, byte offset of data (uint64)
+//
+// The data of each column is one contiguous array that starts at its (8-byte aligned) offset.
+// Version 2 stores the stamps column in milliseconds since the epoch, version 1 had whole seconds. A CSV has no version, so
+// its stamps are taken to be seconds when they are too small to be milliseconds.
+// Version 3 adds the plots column: the plot count of the harvester that did the check, from which the expected number
+// of eligible plots follows (plots / PLOT_FILTER.)
+
+#define EXPORT_CSV	0
+#define EXPORT_BIN	1
+
+typedef void (*import_fn)( void* user, stamp_t t, int eligi, int proof, int poolpr, float durat, int plots );
+
+extern long export_history( const quarterhr_t* quarters, FILE* f, int format, time_t from, time_t to );
+
+// Reads a file that export_history() wrote, of any version, and passes on its entries in order.
+// Returns the nr of entries, or -1 if it is not an export, or could not be read.
+extern long import_history( FILE* f, import_fn fn, void* user );
+
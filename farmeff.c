@@ -0,0 +1,50 @@
+// farmeff.c
+//
+// by Abraham Stolk.
+
+#include <math.h>
+
+#include "farmeff.h"
+
+
+#define Z95		1.96f
+#define MINEXPECTED	5.0f	// Below this, the normal approximation is not worth much.
+
+
+void farmeff_add( farmeff_t* fe, int eligible, int plots, int filter )
+{
+	if ( plots <= 0 || eligible < 0 )
+		return;
+	const float passrate = 1.0f / filter;
+	fe->observed += eligible;
+	fe->expected += plots * passrate;
+	fe->variance += plots * passrate * ( 1.0f - passrate );
+}
+
+
+void farmeff_merge( farmeff_t* dst, const farmeff_t* src )
+{
+	dst->observed += src->observed;
+	dst->expected += src->expected;
+	dst->variance += src->variance;
+}
+
+
+int farmeff_estimate( const farmeff_t* fe, float* ratio, float* lo, float* hi )
+{
+	const double e = fe->expected;
+	if ( e < MINEXPECTED )
+		return 0;
+	const double o = fe->observed;
+	const double v = fe->variance;
+	// When only a fraction r of the plots gets searched, the observed count has mean r*e and variance (about) r*v.
+	// The bounds are the r for which o is exactly Z95 standard deviations away: roots of e²r² - (2oe + z²v)r + o² = 0.
+	const double z2v = Z95 * Z95 * v;
+	const double b = 2 * o * e + z2v;
+	const double root = sqrt( z2v * ( 4 * o * e + z2v ) );
+	*ratio = (float) ( o / e );
+	*lo = (float) ( ( b - root ) / ( 2 * e * e ) );
+	*hi = (float) ( ( b + root ) / ( 2 * e * e ) );
+	return 1;
+}
+
@@ -0,0 +1,28 @@
+// farmeff.h
+//
+// by Abraham Stolk.
+
+// Farm effectiveness: how many plots passed the filter, versus how many should have, given the plot count.
+//
+// Every plot passes the filter of a challenge with a chance of 1 in PLOT_FILTER, so a harvester that reports N plots
+// should see N/PLOT_FILTER eligible plots per check, on average. If it sees fewer, it is not searching all of the plots
+// that it claims to have, for instance because a drive stalled.
+//
+// The sums are kept per quarter-hour, and can be added up for any window.
+// The bounds are a 95% score interval for the ratio: narrow after a day, wide for a single quarter.
+
+typedef struct farmeff
+{
+	int	observed;	// Nr of eligible plots that were reported.
+	float	expected;	// Nr of eligible plots that we expected, from the plot counts.
+	float	variance;	// Variance of the observed count, when all plots are searched.
+} farmeff_t;
+
+
+extern void farmeff_add( farmeff_t* fe, int eligible, int plots, int filter );
+
+extern void farmeff_merge( farmeff_t* dst, const farmeff_t* src );
+
+// Returns 0 if there is too little to go on, else the observed/expected ratio, and its lower and upper bound.
+extern int  farmeff_estimate( const farmeff_t* fe, float* ratio, float* lo, float* hi );
+
@@ -0,0 +1,280 @@
+// grammar.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "grammar.h"
+
+
+enum { OP_LIT=0, OP_WS, OP_STAMP, OP_VERSION, OP_WORD, OP_HASH, OP_ELIGI, OP_PROOF, OP_QUAL, OP_DURAT, OP_PLOTS };
+
+typedef struct grammardef
+{
+	const char*	name;
+	const char*	pattern;
+	int		versioned;	// Does the line have a version field after the time stamp?
+	int		maxver;		// Picked for versions below this, as major*100 + minor.
+} grammardef_t;
+
+// Oldest first.
+static const grammardef_t defs[ GRAMMAR_NUM ] =
+{
+	{
+		"1.x",
+		"%T harvester %W.harvester.harvester: INFO %E plots were eligible for farming %H... Found %P proofs. Time: %D s. Total %N plots",
+		0, 0
+	},
+	{
+		"2.0-2.4",
+		"%T %V harvester %W.harvester.harvester: INFO %E plots were eligible for farming %H... Found %P proofs. Time: %D s. Total %N plots",
+		1, 205
+	},
+	{
+		"2.5",
+		"%T %V harvester %W.harvester.harvester: INFO challenge_hash: %H ...%E plots were eligible for farming challenge"
+		"Found %P V1 proofs and %Q V2 qualities. Time: %D s. Total %N plots",
+		1, INT_MAX
+	},
+};
+
+
+static int is_space( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+static int hexval( char c )
+{
+	return c >= '0' && c <= '9' ? c - '0' : ( c >= 'a' && c <= 'f' ? c - 'a' + 10 : ( c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1 ) );
+}
+
+
+static void compile( const grammardef_t* def, grammar_t* g )
+{
+	const char* p = def->pattern;
+	int n = 0;
+	while ( *p )
+	{
+		assert( n < GRAMMAR_MAXOPS );
+		grammarop_t* op = g->ops + n++;
+		memset( op, 0, sizeof(grammarop_t) );
+		if ( *p == ' ' )
+		{
+			op->kind = OP_WS;
+			while ( *p == ' ' )
+				p++;
+		}
+		else if ( *p == '%' )
+		{
+			const char* kinds = "TVWHEPQDN";
+			const char* k = strchr( kinds, p[1] );
+			assert( p[1] && k );
+			op->kind = OP_STAMP + (int) ( k - kinds );
+			p += 2;
+		}
+		else
+		{
+			op->kind = OP_LIT;
+			op->lit = p;
+			while ( *p && *p != ' ' && *p != '%' )
+				p++;
+			op->len = (int) ( p - op->lit );
+		}
+	}
+	// A word runs up to whatever literal comes after it.
+	for ( int i=0; i<n; ++i )
+		if ( g->ops[ i ].kind == OP_WORD )
+			g->ops[ i ].stop = ( i+1 < n && g->ops[ i+1 ].kind == OP_LIT ) ? g->ops[ i+1 ].lit[ 0 ] : 0;
+	g->numops = n;
+}
+
+
+// Reads 1 to maxdigits decimal digits.
+static const char* get_int( const char* s, int maxdigits, int* v )
+{
+	int x = 0;
+	int n = 0;
+	while ( n < maxdigits && s[ n ] >= '0' && s[ n ] <= '9' )
+		x = x * 10 + ( s[ n++ ] - '0' );
+	*v = x;
+	return n ? s + n : 0;
+}
+
+
+static const char* get_float( const char* s, float* v )
+{
+	if ( *s < '0' || *s > '9' )
+		return 0;	// strtof() would also take white space, signs, inf and nan.
+	char* end = 0;
+	*v = strtof( s, &end );
+	return end > s ? end : 0;
+}
+
+
+// 2021-05-30T12:34:56.789
+static const char* get_stamp( const char* s, harvline_t* hl )
+{
+	if ( !( s = get_int( s, 4, &hl->year  ) ) || *s++ != '-' ) return 0;
+	if ( !( s = get_int( s, 2, &hl->month ) ) || *s++ != '-' ) return 0;
+	if ( !( s = get_int( s, 2, &hl->day   ) ) || *s++ != 'T' ) return 0;
+	if ( !( s = get_int( s, 2, &hl->hours ) ) || *s++ != ':' ) return 0;
+	if ( !( s = get_int( s, 2, &hl->minut ) ) || *s++ != ':' ) return 0;
+	return get_float( s, &hl->secon );
+}
+
+
+static int run( const grammar_t* g, const char* s, harvline_t* hl )
+{
+	for ( int i=0; i<g->numops && s; ++i )
+	{
+		const grammarop_t* op = g->ops + i;
+		const char* t = s;
+		switch ( op->kind )
+		{
+			case OP_LIT:
+				s = strncmp( s, op->lit, op->len ) ? 0 : s + op->len;
+				break;
+			case OP_WS:
+				while ( is_space( *s ) )
+					s++;
+				break;
+			case OP_STAMP:
+				s = get_stamp( s, hl );
+				break;
+			case OP_VERSION:
+				while ( ( *s >= '0' && *s <= '9' ) || *s == '.' )
+					s++;
+				s = s > t && t[ 0 ] != '.' ? s : 0;
+				break;
+			case OP_WORD:
+				while ( *s && ( op->stop ? *s != op->stop : !is_space( *s ) ) )
+					s++;
+				s = s > t ? s : 0;
+				break;
+			case OP_HASH:
+				hl->hash = s;
+				if ( s[ 0 ] == '0' && ( s[ 1 ] == 'x' || s[ 1 ] == 'X' ) )
+					s += 2;
+				t = s;
+				while ( hexval( *s ) >= 0 )
+					s++;
+				s = s > t ? s : 0;
+				break;
+			case OP_ELIGI:
+				s = get_int( s, 9, &hl->eligi );
+				break;
+			case OP_PROOF:
+				s = get_int( s, 9, &hl->proof );
+				break;
+			case OP_QUAL:
+			{
+				int qual;
+				s = get_int( s, 9, &qual );
+				break;
+			}
+			case OP_DURAT:
+				s = get_float( s, &hl->durat );
+				break;
+			case OP_PLOTS:
+				s = get_int( s, 9, &hl->plots );
+				break;
+		}
+	}
+	return s != 0;
+}
+
+
+// Returns major*100+minor of the version field that follows the time stamp, or -1 if there is none.
+static int version_of( const char* line )
+{
+	const char* s = line;
+	while ( *s && !is_space( *s ) )
+		s++;
+	while ( is_space( *s ) )
+		s++;
+	int major, minor;
+	if ( !( s = get_int( s, 3, &major ) ) || *s++ != '.' || !get_int( s, 3, &minor ) )
+		return -1;
+	return major * 100 + minor;
+}
+
+
+static int pick( const char* line )
+{
+	const int ver = version_of( line );
+	for ( int g=0; g<GRAMMAR_NUM; ++g )
+		if ( ver < 0 ? !defs[ g ].versioned : ( defs[ g ].versioned && ver < defs[ g ].maxver ) )
+			return g;
+	return -1;
+}
+
+
+void grammar_init( grammarset_t* gs )
+{
+	memset( gs, 0, sizeof(grammarset_t) );
+	for ( int g=0; g<GRAMMAR_NUM; ++g )
+		compile( defs + g, gs->grammars + g );
+}
+
+
+int grammar_match( grammarset_t* gs, const char* line, int* cached, harvline_t* hl )
+{
+	const int first = *cached >= 0 ? *cached : pick( line );
+	if ( first >= 0 )
+	{
+		if ( run( gs->grammars + first, line, hl ) )
+		{
+			gs->grammars[ first ].hits += 1;
+			*cached = first;
+			return first;
+		}
+		gs->grammars[ first ].misses += 1;
+	}
+	// The format drifted, maybe the harvester got upgraded. See if another grammar fits.
+	for ( int g=0; g<GRAMMAR_NUM; ++g )
+	{
+		if ( g != first && run( gs->grammars + g, line, hl ) )
+		{
+			gs->grammars[ g ].hits += 1;
+			*cached = g;
+			return g;
+		}
+	}
+	gs->unmatched += 1;
+	return -1;
+}
+
+
+// One line summary with hits/misses per grammar, for the overlay.
+void grammar_format( const grammarset_t* gs, char* s, size_t sz )
+{
+	size_t n = 0;
+	for ( int g=0; g<GRAMMAR_NUM && n < sz; ++g )
+		n += snprintf( s + n, sz - n, "%s%s:%llu/%llu", g ? " " : "GRAMMAR ", defs[ g ].name, (unsigned long long) gs->grammars[ g ].hits, (unsigned long long) gs->grammars[ g ].misses );
+	if ( n < sz )
+		snprintf( s + n, sz - n, " UNMATCHED:%llu", (unsigned long long) gs->unmatched );
+}
+
+
+void grammar_dump( const grammarset_t* gs, FILE* f )
+{
+	for ( int g=0; g<GRAMMAR_NUM; ++g )
+		fprintf
+		(
+			f,
+			"grammar %-8s hits=%llu misses=%llu\n",
+			defs[ g ].name,
+			(unsigned long long) gs->grammars[ g ].hits,
+			(unsigned long long) gs->grammars[ g ].misses
+		);
+	fprintf( f, "grammar %-8s %llu\n", "none", (unsigned long long) gs->unmatched );
+	fflush( f );
+}
+
@@ -0,0 +1,72 @@
+// grammar.h
+//
+// by Abraham Stolk.
+
+// The layouts of the harvester's "plots were eligible" line, as Chia changed them over the versions.
+//
+// Each grammar is written as a pattern, that is compiled once into a list of ops, and matched without sscanf().
+// In a pattern, a space matches any run of white space (or none, like in scanf) and these take a field:
+//	%T	time stamp, like 2021-05-30T12:34:56.789
+//	%V	version, like 2.5.7
+//	%W	a word, up to the next literal character
+//	%H	challenge hash: hex digits, kept as a pointer into the line
+//	%E	nr of eligible plots
+//	%P	nr of proofs
+//	%Q	nr of V2 qualities (not kept)
+//	%D	lookup time in seconds
+//	%N	total nr of plots
+//
+// The grammar that fits a file is picked from the version field of its first harvester line, and then cached.
+// When a line does not match the cached grammar, the others are tried, and the one that matches is cached instead.
+
+#define GRAMMAR_MAXOPS	64
+#define GRAMMAR_NUM	3
+
+typedef struct grammarop
+{
+	int		kind;
+	const char*	lit;	// For literals: the text, not terminated.
+	int		len;
+	char		stop;	// For %W: the character that ends the word. 0 means white space.
+} grammarop_t;
+
+typedef struct grammar
+{
+	grammarop_t	ops[ GRAMMAR_MAXOPS ];
+	int		numops;
+	uint64_t	hits;
+	uint64_t	misses;		// Lines that this grammar was picked for, but did not match.
+} grammar_t;
+
+// The compiled grammars, with their counters. Every reader of logs has its own, so they need no locking.
+typedef struct grammarset
+{
+	grammar_t	grammars[ GRAMMAR_NUM ];
+	uint64_t	unmatched;
+} grammarset_t;
+
+typedef struct harvline
+{
+	int		year;
+	int		month;
+	int		day;
+	int		hours;
+	int		minut;
+	float		secon;
+	const char*	hash;	// Points into the line.
+	int		eligi;
+	int		proof;
+	float		durat;
+	int		plots;
+} harvline_t;
+
+
+extern void grammar_init( grammarset_t* gs );
+
+// Returns the grammar that matched, or -1. Pass -1 in *cached for a new file.
+extern int  grammar_match( grammarset_t* gs, const char* line, int* cached, harvline_t* hl );
+
+extern void grammar_format( const grammarset_t* gs, char* s, size_t sz );
+
+extern void grammar_dump( const grammarset_t* gs, FILE* f );
+
@@ -3,6 +3,7 @@
 // by Abraham Stolk.
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
@@ -13,9 +14,13 @@
 #include <signal.h>
 #include <termios.h>
 #include <errno.h>
+#include <poll.h>
+#include <stdint.h>
 #include <sys/ioctl.h>
 
 #include "grapher.h"
+#include "instrument.h"
+#include "imgwrite.h"
 
 
 #define HALFBLOCK "▀"		// Uses Unicode char U+2580
@@ -31,6 +36,99 @@ char postscript[256];
 
 int grapher_resized = 1;
 
+static int headless = 0;	// Render into the image only, without a terminal.
+
+enum { GFX_HALFBLOCK=0, GFX_SIXEL, GFX_KITTY };
+
+static int gfx = GFX_HALFBLOCK;	// How we get pixels onto the terminal.
+
+static int cellw = 0, cellh = 0;	// Size of a character cell, in pixels.
+
+#define BITMAP_ROW0	3		// First cell row that the bitmap covers. Rows above it hold the text and the top border.
+#define KITTY_ID0	1000		// Image id of the first column, when using the kitty protocol.
+#define RESIZE_SETTLE_MS	150	// How long the terminal size must be stable, before we adapt to it.
+
+uint32_t* bitmap = 0;
+int bitmaph = 0;
+static int bitmaprows = 0;		// Nr of cell rows that the bitmap covers.
+static uint8_t* coldirty = 0;		// Which columns of the bitmap must be sent again?
+static uint8_t* indices = 0;		// Palette index of each pixel in the bitmap.
+
+
+// Sends a query to the terminal, and collects the reply until its final char shows up, or the terminal stays quiet.
+static int query_terminal( const char* query, char final, char* reply, int sz )
+{
+	struct termios orig, raw;
+	const int tty = tcgetattr( STDIN_FILENO, &orig ) == 0;
+	if ( tty )
+	{
+		raw = orig;
+		raw.c_lflag &= ~( ECHO | ICANON );
+		raw.c_cc[ VMIN ] = 0;
+		raw.c_cc[ VTIME ] = 0;
+		tcsetattr( STDIN_FILENO, TCSANOW, &raw );
+	}
+	fflush( stdout );
+	int len = 0;
+	if ( write( STDOUT_FILENO, query, strlen( query ) ) > 0 )
+	{
+		while ( len < sz-1 )
+		{
+			struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+			char c;
+			if ( poll( &pfd, 1, 300 ) <= 0 || read( STDIN_FILENO, &c, 1 ) != 1 )
+				break;
+			reply[ len++ ] = c;
+			reply[ len ] = 0;
+			if ( c == final && strstr( reply, "\x1b[" ) )
+				break;
+		}
+	}
+	reply[ len ] = 0;
+	if ( tty )
+		tcsetattr( STDIN_FILENO, TCSANOW, &orig );
+	return len;
+}
+
+
+// Does the reply to a Primary Device Attributes query list sixel graphics (attribute 4)?
+static int has_sixel( const char* reply )
+{
+	const char* p = strstr( reply, "\x1b[?" );
+	if ( !p )
+		return 0;
+	p += 3;
+	while ( *p && *p != 'c' )
+	{
+		if ( atoi( p ) == 4 )
+			return 1;
+		while ( *p && *p != ';' && *p != 'c' )
+			p++;
+		if ( *p == ';' )
+			p++;
+	}
+	return 0;
+}
+
+
+// Kitty tells us when it understood the graphics query. Every terminal answers the attributes query that follows.
+// Set GRAPHICS=sixel|kitty|halfblock to skip the detection.
+static void detect_graphics( void )
+{
+	const char* env = getenv( "GRAPHICS" );
+	if ( env )
+	{
+		gfx = !strcmp( env, "sixel" ) ? GFX_SIXEL : ( !strcmp( env, "kitty" ) ? GFX_KITTY : GFX_HALFBLOCK );
+		return;
+	}
+	char reply[ 256 ];
+	query_terminal( "\x1b_Gi=31,s=1,v=1,a=q,t=d,f=24;AAAA\x1b\\\x1b[c", 'c', reply, sizeof(reply) );
+	if ( strstr( reply, "_Gi=31;OK" ) )
+		gfx = GFX_KITTY;
+	else if ( has_sixel( reply ) )
+		gfx = GFX_SIXEL;
+}
+
 
 static void get_terminal_size(void)
 {
@@ -38,21 +136,93 @@ static void get_terminal_size(void)
 	ioctl(STDOUT_FILENO, TIOCGWINSZ, &tmp);
 	termw = tmp.ws_col;
 	termh = tmp.ws_row;
+	// Too small to hold the text and the border: keep the layout sane, even if it does not fit.
+	termw = termw < 16 ? 16 : termw;
+	termh = termh < 8 ? 8 : termh;
+	if ( gfx == GFX_HALFBLOCK )
+		return;
+	cellw = tmp.ws_xpixel / termw;
+	cellh = tmp.ws_ypixel / termh;
+	if ( !cellw || !cellh )
+	{
+		// Not all terminals fill in the pixel size. Ask for the cell size directly.
+		char reply[ 64 ];
+		int h=0, w=0;
+		query_terminal( "\x1b[16t", 't', reply, sizeof(reply) );
+		const char* p = strstr( reply, "\x1b[6;" );
+		if ( p && sscanf( p+4, "%d;%dt", &h, &w ) == 2 )
+		{
+			cellw = w;
+			cellh = h;
+		}
+	}
+	if ( ( !cellw || !cellh ) && gfx == GFX_KITTY )
+	{
+		// Kitty scales the images to the cells anyway, so we just pick a resolution.
+		cellw = 8;
+		cellh = 16;
+	}
+	if ( !cellw || !cellh || cellw > 64 || cellh > 128 )
+	{
+		gfx = GFX_HALFBLOCK;	// Sixel needs to know the exact size.
+		cellw = cellh = 0;
+	}
 }
 
 
-static void setup_image(void)
+// Makes sure that the buffer can hold need bytes. Grows it by half again, so that a resize storm does not reallocate every time.
+static void* reserve( void* p, size_t* cap, size_t need )
+{
+	if ( need <= *cap )
+		return p;
+	const size_t grown = *cap + *cap / 2;
+	*cap = need > grown ? need : grown;
+	p = realloc( p, *cap );
+	assert( p );
+	return p;
+}
+
+
+static size_t imcap = 0;
+static size_t overlaycap = 0;
+static size_t bitmapcap = 0;
+static size_t indicescap = 0;
+static size_t coldirtycap = 0;
+
+
+// With a bitmap capable terminal, the graph gets its own image at the full pixel resolution.
+static void setup_bitmap( uint32_t border )
 {
-	if (im) free(im);
-	if (overlay) free(overlay);
+	static uint32_t* bitmapmem = 0;	// Kept when not in use, so that it can be reused.
+	bitmap = 0;
+	bitmaprows = imh/2 - 1 - BITMAP_ROW0;
+	if ( gfx == GFX_HALFBLOCK || headless || bitmaprows < 1 )
+		return;
+
+	bitmaph = bitmaprows * cellh;
+	bitmapmem = (uint32_t*) reserve( bitmapmem, &bitmapcap, imw * bitmaph * 4 );
+	bitmap = bitmapmem;
+	indices = (uint8_t*) reserve( indices, &indicescap, imw * bitmaph );
+	coldirty = (uint8_t*) reserve( coldirty, &coldirtycap, imw );
+	memset( bitmap, 0, imw * bitmaph * 4 );
+	memset( coldirty, 1, imw );
+	for ( int y=0; y<bitmaph; ++y )
+	{
+		bitmap[ y * imw ] = border;
+		bitmap[ y * imw + imw - 1 ] = border;
+	}
+}
+
 
+static void setup_image(void)
+{
 	imw = termw;
-	imh = 2 * (termh-1);
+	imh = headless ? termh : 2 * (termh-1);
 	const size_t sz = imw * imh * 4;
-	im = (uint32_t*) malloc(sz);
+	im = (uint32_t*) reserve( im, &imcap, sz );
 	memset( im, 0x00, sz );
 
-	overlay = (char*) malloc( imw * (imh/2) );
+	overlay = (char*) reserve( overlay, &overlaycap, imw * (imh/2) );
 	memset( overlay, 0x00, imw * (imh/2) );
 
 	// Draw border into image.
@@ -66,16 +236,22 @@ static void setup_image(void)
 			uint32_t colour = a<<24 | b<<16 | g<<8 | r<<0;
 			im[y * imw + x] = x == 0 || x == imw - 1 || y == 4 || y == imh - 1 ? colour : 0x0;
 		}
+
+	setup_bitmap( 0xff303f30 );
 }
 
 
+static volatile sig_atomic_t winch_count = 0;	// Bumped by every SIGWINCH.
+
+
 static void sigwinchHandler(int sig)
 {
 	grapher_resized = 1;
+	winch_count++;
 }
 
 
-static void print_image_double_res( int w, int h, unsigned char* data, char* overlay )
+static void print_image_double_res( FILE* f, int w, int h, unsigned char* data, char* overlay )
 {
 	if ( h & 1 )
 		h--;
@@ -114,14 +290,237 @@ static void print_image_double_res( int w, int h, unsigned char* data, char* ove
 			strncat( line, tripl, sizeof(line) - strlen(line) - 1 );
 		}
 		strncat( line, RESETALL, sizeof(line) - strlen(line) - 1 );
-		if ( y == h - 1 )
-			printf( "%s", line );
+		INSTR_COUNT( CNT_BYTES, strlen( line ) + 1 );
+		fputs( line, f );
+		if ( y != h - 1 )
+			fputc( '\n', f );
+	}
+}
+
+
+
+// Output buffer for the bitmap encoders.
+static char* obuf = 0;
+static size_t obufsz = 0;
+static size_t obuflen = 0;
+
+
+static void emit( const char* fmt, ... ) __attribute__(( format( printf, 1, 2 ) ));
+
+static void emit( const char* fmt, ... )
+{
+	while ( 1 )
+	{
+		va_list args;
+		va_start( args, fmt );
+		const int n = vsnprintf( obuf + obuflen, obufsz - obuflen, fmt, args );
+		va_end( args );
+		if ( n >= 0 && obuflen + n < obufsz )
+		{
+			obuflen += n;
+			return;
+		}
+		obufsz = obufsz ? 2 * obufsz : 65536;
+		obuf = (char*) realloc( obuf, obufsz );
+		assert( obuf );
+	}
+}
+
+
+static void emit_flush( void )
+{
+	fwrite( obuf, 1, obuflen, stdout );
+	INSTR_COUNT( CNT_BYTES, obuflen );
+	obuflen = 0;
+}
+
+
+// Gives every colour in columns [x0,x1) of the bitmap a palette index, and returns the palette size.
+// Normally there are far fewer than 256 colours, but if not, we drop bits until they fit.
+static int build_palette( int x0, int x1, uint32_t* pal )
+{
+	static const uint32_t masks[] = { 0xffffff, 0xfcfcfc, 0xf8f8f8, 0xf0f0f0, 0xe0e0e0, 0xc0c0c0 };
+	uint32_t keys[ 1024 ];
+	uint8_t vals[ 1024 ];
+	for ( int m=0; m<(int)(sizeof(masks)/sizeof(masks[0])); ++m )
+	{
+		memset( keys, 0, sizeof(keys) );
+		int n = 0;
+		for ( int y=0; y<bitmaph && n <= 256; ++y )
+			for ( int x=x0; x<x1 && n <= 256; ++x )
+			{
+				const uint32_t key = ( bitmap[ y * imw + x ] & masks[ m ] ) | 0x1000000;
+				uint32_t h = ( key * 2654435761u ) >> 22;
+				while ( keys[ h ] && keys[ h ] != key )
+					h = ( h + 1 ) & 1023;
+				if ( !keys[ h ] )
+				{
+					if ( n == 256 )
+					{
+						n++;
+						break;
+					}
+					keys[ h ] = key;
+					vals[ h ] = (uint8_t) n;
+					pal[ n++ ] = key & 0xffffff;
+				}
+				indices[ y * imw + x ] = vals[ h ];
+			}
+		if ( n <= 256 )
+			return n;
+	}
+	assert( 0 );	// 64 colours always fit.
+	return 0;
+}
+
+
+static void emit_sixel_run( int ch, int len )
+{
+	if ( len > 3 )
+		emit( "!%d%c", len, ch );
+	else
+		while ( len-- )
+			emit( "%c", ch );
+}
+
+
+// Sends columns [x0,x1) as one sixel image, every column cellw pixels wide.
+static void send_sixel( int x0, int x1 )
+{
+	uint32_t pal[ 256 ];
+	const int numpal = build_palette( x0, x1, pal );
+	emit( "\x1b[%d;%dH\x1bP0;1;0q\"1;1;%d;%d", BITMAP_ROW0+1, x0+1, ( x1 - x0 ) * cellw, bitmaph );
+	for ( int i=0; i<numpal; ++i )
+	{
+		const uint32_t c = pal[ i ];
+		emit( "#%d;2;%d;%d;%d", i, ( ( c & 0xff ) * 100 + 127 ) / 255, ( ( ( c >> 8 ) & 0xff ) * 100 + 127 ) / 255, ( ( c >> 16 ) * 100 + 127 ) / 255 );
+	}
+	for ( int y0=0; y0<bitmaph; y0 += 6 )
+	{
+		const int rows = bitmaph - y0 < 6 ? bitmaph - y0 : 6;
+		uint8_t used[ 256 ];
+		memset( used, 0, numpal );
+		for ( int r=0; r<rows; ++r )
+			for ( int x=x0; x<x1; ++x )
+				used[ indices[ ( y0 + r ) * imw + x ] ] = 1;
+		int first = 1;
+		for ( int c=0; c<numpal; ++c )
+		{
+			if ( !used[ c ] )
+				continue;
+			emit( first ? "#%d" : "$#%d", c );
+			first = 0;
+			int runch = -1;
+			int runlen = 0;
+			for ( int x=x0; x<x1; ++x )
+			{
+				int bits = 0;
+				for ( int r=0; r<rows; ++r )
+					bits |= ( indices[ ( y0 + r ) * imw + x ] == c ) << r;
+				if ( 63 + bits != runch )
+				{
+					emit_sixel_run( runch, runlen );
+					runch = 63 + bits;
+					runlen = 0;
+				}
+				runlen += cellw;
+			}
+			if ( runch != 63 )
+				emit_sixel_run( runch, runlen );	// No need to send the empty tail.
+		}
+		emit( "-" );
+	}
+	emit( "\x1b\\" );
+}
+
+
+static void emit_base64( const uint8_t* p, size_t len )
+{
+	static const char* digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for ( size_t i=0; i<len; i += 3 )
+	{
+		const uint32_t v = p[i] << 16 | ( i+1 < len ? p[i+1] << 8 : 0 ) | ( i+2 < len ? p[i+2] : 0 );
+		emit
+		(
+			"%c%c%c%c",
+			digits[ ( v >> 18 ) & 63 ],
+			digits[ ( v >> 12 ) & 63 ],
+			i+1 < len ? digits[ ( v >> 6 ) & 63 ] : '=',
+			i+2 < len ? digits[ v & 63 ] : '='
+		);
+	}
+}
+
+
+// Sends column x as a palette PNG, one pixel wide, that kitty stretches over the cells.
+// Every column has its own image id, so sending it again replaces the old one.
+static void send_kitty( int x )
+{
+	uint32_t pal[ 256 ];
+	const int numpal = build_palette( x, x+1, pal );
+	char* png = 0;
+	size_t pngsz = 0;
+	FILE* f = open_memstream( &png, &pngsz );
+	if ( !f )
+		return;
+	imgwrite_png_indexed( f, 1, bitmaph, indices + x, imw, pal, numpal );
+	fclose( f );
+
+	emit( "\x1b[%d;%dH", BITMAP_ROW0+1, x+1 );
+	const size_t chunk = 3072;	// Kitty wants at most 4096 bytes of base64 per escape code.
+	for ( size_t off=0; off<pngsz; off += chunk )
+	{
+		const int more = off + chunk < pngsz;
+		if ( off == 0 )
+			emit( "\x1b_Ga=T,f=100,i=%d,p=1,c=1,r=%d,q=2,C=1,m=%d;", KITTY_ID0 + x, bitmaprows, more );
 		else
-			puts( line );
+			emit( "\x1b_Gm=%d;", more );
+		emit_base64( (const uint8_t*) png + off, more ? chunk : pngsz - off );
+		emit( "\x1b\\" );
 	}
+	free( png );
 }
 
 
+// Sends the columns of the bitmap that changed since last time.
+static void send_bitmap( void )
+{
+	for ( int x0=0; x0<imw; ++x0 )
+	{
+		if ( !coldirty[ x0 ] )
+			continue;
+		int x1 = x0+1;
+		while ( x1 < imw && coldirty[ x1 ] )
+			x1++;
+		if ( gfx == GFX_SIXEL )
+			send_sixel( x0, x1 );
+		else
+			for ( int x=x0; x<x1; ++x )
+				send_kitty( x );
+		memset( coldirty + x0, 0, x1 - x0 );
+		x0 = x1;
+	}
+	emit_flush();
+}
+
+
+void grapher_column_changed( int x )
+{
+	if ( coldirty && x >= 0 && x < imw )
+		coldirty[ x ] = 1;
+}
+
+
+static int altscreen = 0;
+
+static void leave_altscreen( void )
+{
+	if ( altscreen )
+		printf( ALTSCREEN_OFF );
+	altscreen = 0;
+	fflush( stdout );
+}
+
 
 int grapher_init( void )
 {
@@ -136,33 +535,105 @@ int grapher_init( void )
 	if ( sigaction( SIGWINCH, &sa, 0 ) == -1 )
 		perror( "sigaction" );
 
+	detect_graphics();
+
+	// Draw on the alternate screen, so that the scrollback of the user stays as it was.
+	printf( ALTSCREEN_ON );
+	altscreen = 1;
+	atexit( leave_altscreen );
+
+	return 0;
+}
+
+
+// Instead of a terminal, we render an image of w by h pixels.
+int grapher_init_headless( int w, int h )
+{
+	if ( w < 16 || h < 16 || w > 8192 || h > 8192 )
+		return -1;
+	headless = 1;
+	termw = w;
+	termh = h;
 	return 0;
 }
 
 
-void grapher_adapt_to_new_size(void)
+// Dragging a window edge sends a burst of SIGWINCH. We only adapt when the size has been stable for a little while.
+// Returns 1 if the image got a new layout.
+int grapher_adapt_to_new_size(void)
 {
-	printf(CLEARSCREEN);
-	get_terminal_size();
+	if ( !headless )
+	{
+		static sig_atomic_t seen = -1;
+		static struct timespec seenat;
+		struct timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		if ( winch_count != seen )
+		{
+			seen = winch_count;
+			seenat = now;
+			if ( im )
+				return 0;	// No need to wait for the very first layout.
+		}
+		const long elapsed_ms = ( now.tv_sec - seenat.tv_sec ) * 1000 + ( now.tv_nsec - seenat.tv_nsec ) / 1000000;
+		if ( im && elapsed_ms < RESIZE_SETTLE_MS )
+			return 0;
+
+		get_terminal_size();
+		if ( gfx == GFX_KITTY )
+			printf( KITTY_DELETE_ALL );
+		printf( CLEARSCREEN );
+	}
 	setup_image();
 	grapher_resized = 0;
+	return 1;
 }
 
 
 void grapher_update( void )
 {
-	printf( CURSORHOME );
-	print_image_double_res( imw, imh, (unsigned char*) im, overlay );
+	if ( headless )
+		return;
+	INSTR_BEGIN( t0 );
+	if ( bitmap )
+	{
+		// The graph goes out as a bitmap. Only the text rows above it, and the row below it, are half-blocks.
+		send_bitmap();
+		printf( CURSORHOME );
+		print_image_double_res( stdout, imw, 2*BITMAP_ROW0, (unsigned char*) im, overlay );
+		printf( "\x1b[%d;1H", imh/2 );
+		print_image_double_res( stdout, imw, 2, (unsigned char*) ( im + ( imh-2 ) * imw ), overlay + ( imh/2-1 ) * imw );
+	}
+	else
+	{
+		printf( CURSORHOME );
+		print_image_double_res( stdout, imw, imh, (unsigned char*) im, overlay );
+	}
+	INSTR_END( STAGE_PRINT, t0 );
+	INSTR_COUNT( CNT_FRAMES, 1 );
 
 	printf( "%s", postscript );
 	fflush( stdout );
 }
 
 
+// The half-block frame, as grapher_update() sends it to the terminal. Works headless too, so that it can be tested.
+void grapher_print_frame( FILE* f )
+{
+	fprintf( f, CURSORHOME );
+	print_image_double_res( f, imw, imh, (unsigned char*) im, overlay );
+	fprintf( f, "%s", postscript );
+}
+
+
 void grapher_exit(void)
 {
 	free(im);
-	printf( CLEARSCREEN );
+	im = 0;
+	imcap = 0;
+	if ( !headless && gfx == GFX_KITTY )
+		printf( KITTY_DELETE_ALL );
+	leave_altscreen();
 }
 
 
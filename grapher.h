@@ -11,13 +11,22 @@ extern char postscript[256];
 
 extern int grapher_resized;
 
+extern uint32_t* bitmap;	// When the terminal can show bitmaps: the graph at full pixel resolution, imw wide. Otherwise 0.
+extern int bitmaph;
+
 
 extern int grapher_init( void );
 
-extern void grapher_adapt_to_new_size( void );
+extern int grapher_init_headless( int w, int h );
+
+extern int  grapher_adapt_to_new_size( void );
 
 extern void grapher_update( void );
 
+extern void grapher_column_changed( int x );
+
+extern void grapher_print_frame( FILE* f );
+
 extern void grapher_exit( void );
 
 
@@ -25,10 +34,16 @@ extern void grapher_exit( void );
 
 #define CURSORHOME	"\x1b[H"
 
-#define CLEARSCREEN	"\e[H\e[2J\e[3J"
+#define CLEARSCREEN	"\e[H\e[2J"
+
+#define ALTSCREEN_ON	"\x1b[?1049h"
+
+#define ALTSCREEN_OFF	"\x1b[?1049l"
 
 #define SETFG		"\x1b[38;2;"
 
 #define SETBG		"\x1b[48;2;"
 
+#define KITTY_DELETE_ALL	"\x1b_Ga=d,d=A,q=2\x1b\\"
+
 
@@ -0,0 +1,854 @@
+// harvestgraph.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "quarters.h"
+#include "plotseries.h"
+#include "reorder.h"
+#include "splatency.h"
+#include "grammar.h"
+#include "rollup.h"
+#include "colagg.h"
+#include "export.h"
+#include "harvestgraph.h"
+
+
+#define POOL_MATCH_WINDOW	30000		// A partial is submitted at most this many milliseconds after its proof was found.
+#define MAXPENDING		16
+
+typedef char assert_num_columns[ HG_NUM_COLUMNS == MAXHIST ? 1 : -1 ];
+typedef char assert_num_days[ HG_MAX_DAYS == ROLLUP_DAYS ? 1 : -1 ];
+
+
+struct harvestgraph
+{
+	quarterhr_t	quarters[ MAXHIST ];
+	plotseries_t	plotcount;		// Run-length encoded history of the plot count.
+	reorder_t	reorder;		// Puts entries back in order, and weeds out the duplicates.
+	splatency_t	splat;			// Joins farmer and harvester lines, to see how long signage points take.
+	grammarset_t	grammars;
+	rollup_t	rollup;			// Daily totals, for reports.
+	int		grammar;		// Line grammar that fits the source we are reading, once known.
+	int		filter;			// Plot filter, for the expected nr of eligible plots.
+
+	stamp_t		newest_stamp;		// The stamp of the latest entry.
+	stamp_t		newest_seen;		// The stamp of the latest entry that we parsed, but may still be in the reorder buffer.
+	stamp_t		oldeststamp;
+	stamp_t		imported;		// The stamp of the latest entry that we imported. The logs do not add what it has.
+	int		entries_added;
+
+	double		total_response_time_eligible;
+	double		worst_response_time_eligible;
+	int		total_eligible_responses;
+
+	int		has_access_to_farmer_log;
+	int		pool_proof_seen;
+	stamp_t		pending_partials[ MAXPENDING ];	// Partials that are waiting for their harvester line to show up.
+	int		num_pending;
+
+	uint64_t	matched;
+	uint64_t	rejected;
+	uint64_t	shifts;
+	stamp_t		bad_stamp;		// An entry that did not fit in the history.
+
+	hg_entry_fn	on_entry;
+	void*		entry_user;
+	hg_partial_fn	on_partial;
+	void*		partial_user;
+
+	char*		carry;			// Incomplete last line of hg_feed_bytes().
+	size_t		carrysz;
+	size_t		carrylen;
+
+	int		stamphour;		// The local hour that stamphourlo is for, as yyyymmddhh.
+	time_t		stamphourlo;		// Start of that hour, so that we need mktime() once an hour, not for every line.
+
+	colagg_t	bins;			// Pixel rows of a column, for the graph height that we last drew.
+	colagg_fn	aggregate;		// The fastest column aggregation kernel that the cpu can run.
+};
+
+
+static void init_quarters( harvestgraph_t* hg, time_t now )
+{
+	time_t q = now / 900;
+	time_t q_lo = (q+0) * 900;
+	time_t q_hi = (q+1) * 900;
+	for ( int i=MAXHIST-1; i>=0; --i )	// [0..MAXHIST)
+	{
+		const int ir = MAXHIST-1-i;	// [MAXHIST-1..0]
+		hg->quarters[i].sz = 0;
+		memset( &hg->quarters[i].eff, 0, sizeof(farmeff_t) );
+		hg->quarters[i].timelo = q_lo - 900 * ir;
+		hg->quarters[i].timehi = q_hi - 900 * ir;
+	}
+}
+
+
+// Scrolls the history by n quarters at once, so that a jump far into the future costs no more than a single step.
+static void shift_quarters( harvestgraph_t* hg, time_t n )
+{
+	quarterhr_t* quarters = hg->quarters;
+	hg->shifts += n;
+	const time_t lo = quarters[ 0 ].timelo + 900 * n;
+	const int keep = n < MAXHIST ? (int) ( MAXHIST - n ) : 0;
+	memmove( quarters, quarters + MAXHIST - keep, keep * sizeof(quarterhr_t) );
+	for ( int i=keep; i<MAXHIST; ++i )
+	{
+		quarters[ i ].sz = 0;
+		memset( &quarters[ i ].eff, 0, sizeof(farmeff_t) );
+		quarters[ i ].timelo = lo + 900 * i;
+		quarters[ i ].timehi = lo + 900 * ( i + 1 );
+	}
+	plotseries_trim( &hg->plotcount, quarters[ 0 ].timelo );
+}
+
+
+static int too_old( const harvestgraph_t* hg, time_t t )
+{
+	return t <= hg->quarters[ 0 ].timelo;
+}
+
+
+static int too_new( const harvestgraph_t* hg, time_t t )
+{
+	const int last = MAXHIST-1;
+	return t >= hg->quarters[last].timehi;
+}
+
+
+static int quarterslot( const harvestgraph_t* hg, time_t tim )
+{
+	const int last = MAXHIST-1;
+	const time_t d = tim - hg->quarters[last].timehi;
+	if ( d >= 0 )
+		return INT_MAX;
+	return (int) ( MAXHIST - 1 + ( d / 900 ) );
+}
+
+
+// Index of first entry in quarter s with a stamp after t.
+static int upper_bound( const harvestgraph_t* hg, int s, stamp_t t )
+{
+	int lo = 0;
+	int hi = hg->quarters[s].sz;
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( hg->quarters[s].stamps[ mid ] <= t )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+// Finds the nearest entry at or before tim, with a proof that was not claimed by a partial yet.
+static int find_proof_for_partial( const harvestgraph_t* hg, stamp_t tim, int* slot, int* idx )
+{
+	const quarterhr_t* quarters = hg->quarters;
+	if ( too_old( hg, tim / 1000 ) )
+		return 0;
+	int s = too_new( hg, tim / 1000 ) ? MAXHIST-1 : quarterslot( hg, tim / 1000 );
+	if ( s < 0 )
+		return 0;
+	int i = upper_bound( hg, s, tim ) - 1;
+	while ( s >= 0 )
+	{
+		for ( ; i>=0; --i )
+		{
+			if ( quarters[s].stamps[i] < tim - POOL_MATCH_WINDOW )
+				return 0;
+			if ( quarters[s].poolpr[i] < quarters[s].proofs[i] )
+			{
+				*slot = s;
+				*idx = i;
+				return 1;
+			}
+		}
+		if ( quarters[s].timelo * 1000 <= tim - POOL_MATCH_WINDOW )
+			return 0;
+		s -= 1;
+		i = s >= 0 ? quarters[s].sz - 1 : -1;
+	}
+	return 0;
+}
+
+
+// The plot count of the farm goes into the plot series, the plot count of the harvester that did the check is kept with the entry.
+static int add_entry( harvestgraph_t* hg, stamp_t t, int eligi, int proof, int poolpr, float durat, int plots, int harvplots )
+{
+	quarterhr_t* quarters = hg->quarters;
+	const time_t secs = (time_t) ( t / 1000 );
+	if ( t <= hg->imported )
+		return 0;	// An export that we imported, had it already.
+	if ( too_new( hg, secs ) )
+		shift_quarters( hg, ( secs - hg->quarters[ MAXHIST-1 ].timehi ) / 900 + 1 );
+	// Days go back further than the quarters do.
+	rollup_check( &hg->rollup, t, eligi, proof, poolpr, durat, plots );
+	if ( too_old( hg, secs ) )
+		return 0;	// signal not adding.
+	int s = quarterslot( hg, secs );
+	if ( s < 0 || s >= MAXHIST )
+	{
+		hg->bad_stamp = t;
+		return -1;	// signal failure.
+	}
+	const int sz = quarters[s].sz;
+	if ( sz == MAXENTR )
+		return 0;	// Way more entries than a harvester should produce. Drop it.
+	const int i = ( sz && quarters[s].stamps[sz-1] > t ) ? upper_bound( hg, s, t ) : sz;
+	if ( i < sz )
+	{
+		// Only happens when merging the streams of several agents: make room, to keep the stamps sorted.
+		const int n = sz - i;
+		memmove( quarters[s].stamps+i+1, quarters[s].stamps+i, n * sizeof(stamp_t) );
+		memmove( quarters[s].eligib+i+1, quarters[s].eligib+i, n * sizeof(int) );
+		memmove( quarters[s].proofs+i+1, quarters[s].proofs+i, n * sizeof(int) );
+		memmove( quarters[s].poolpr+i+1, quarters[s].poolpr+i, n * sizeof(int) );
+		memmove( quarters[s].durati+i+1, quarters[s].durati+i, n * sizeof(float) );
+		memmove( quarters[s].plots +i+1, quarters[s].plots +i, n * sizeof(int) );
+	}
+	quarters[s].stamps[i] = t;
+	quarters[s].eligib[i] = eligi;
+	quarters[s].proofs[i] = proof;
+	quarters[s].poolpr[i] = poolpr;
+	quarters[s].durati[i] = durat;
+	quarters[s].plots[i] = harvplots;
+	quarters[s].sz += 1;
+	farmeff_add( &quarters[s].eff, eligi, harvplots, hg->filter );
+
+	if ( eligi > 0 )
+	{
+		hg->total_response_time_eligible += durat;
+		hg->worst_response_time_eligible = durat > hg->worst_response_time_eligible ? durat : hg->worst_response_time_eligible;
+		hg->total_eligible_responses += 1;
+	}
+	if ( hg->plotcount.latest == -1 )
+		hg->oldeststamp = t;
+	plotseries_add( &hg->plotcount, secs, plots );
+	hg->oldeststamp = t < hg->oldeststamp ? t : hg->oldeststamp;
+	hg->newest_stamp = t > hg->newest_stamp ? t : hg->newest_stamp;
+	hg->entries_added += 1;
+
+	if ( hg->on_entry )
+	{
+		const hg_entry_t e = { t, eligi, proof, durat, harvplots };
+		hg->on_entry( hg->entry_user, &e, plots );
+	}
+	return 1;
+}
+
+
+// All entries up to newest_stamp are in the history now, so partials up to that time can be matched with their proof.
+static void resolve_pending_partials( harvestgraph_t* hg )
+{
+	int k=0;
+	while ( k < hg->num_pending )
+	{
+		int s, i;
+		const stamp_t p = hg->pending_partials[k];
+		if ( p > hg->newest_stamp )
+		{
+			k++;
+			continue;
+		}
+		if ( find_proof_for_partial( hg, p, &s, &i ) )
+			hg->quarters[s].poolpr[i] += 1;
+		hg->pending_partials[k] = hg->pending_partials[ --hg->num_pending ];
+	}
+}
+
+
+static int mark_proof_as_a_pool_proof( harvestgraph_t* hg, stamp_t tim )
+{
+	if ( tim <= hg->imported )
+		return 0;	// Counted with the entries of an export.
+	hg->pool_proof_seen = 1;
+	rollup_partial( &hg->rollup, tim );
+	if ( hg->on_partial )
+		hg->on_partial( hg->partial_user, tim );
+
+	int s, i;
+	if ( tim <= hg->newest_stamp )
+	{
+		if ( !find_proof_for_partial( hg, tim, &s, &i ) )
+			return -1;
+		hg->quarters[s].poolpr[i] += 1;
+		return 0;
+	}
+
+	// The harvester line for this partial may not have made it into the history yet. Hold on to it, until it does.
+	if ( hg->num_pending == MAXPENDING )
+	{
+		int oldest = 0;
+		for ( int k=1; k<hg->num_pending; ++k )
+			oldest = hg->pending_partials[k] < hg->pending_partials[oldest] ? k : oldest;
+		hg->pending_partials[ oldest ] = hg->pending_partials[ --hg->num_pending ];
+	}
+	hg->pending_partials[ hg->num_pending++ ] = tim;
+	return 1;
+}
+
+
+// Log stamps are in local time. Within the same hour, the conversion is just an addition.
+static stamp_t log_stamp( harvestgraph_t* hg, int year, int month, int day, int hours, int minut, float secon )
+{
+	const int msecs = (int) ( secon * 1000 + 0.5f );
+	const int hour = ( ( year * 100 + month ) * 100 + day ) * 100 + hours;
+	if ( hour != hg->stamphour )
+	{
+		struct tm tim =
+		{
+			0,		// seconds 0..60
+			0,		// minutes 0..59
+			hours,		// hours 0..23
+			day,		// day 1..31
+			month-1,	// month 0..11
+			year-1900,	// year - 1900
+			-1,
+			-1,
+			-1
+		};
+		hg->stamphourlo = mktime( &tim );
+		hg->stamphour = hour;
+	}
+	const time_t logtim = hg->stamphourlo + minut * 60 + msecs / 1000;
+	return (stamp_t) logtim * 1000 + msecs % 1000;
+}
+
+
+// Moves the entries that can no longer be overtaken by late arrivals, from the reorder buffer into the history.
+static int commit_entries( harvestgraph_t* hg, stamp_t upto )
+{
+	entry_t e;
+	while ( reorder_pop( &hg->reorder, upto, &e ) )
+	{
+		const int added = add_entry( hg, e.t, e.eligi, e.proof, 0, e.durat, e.plots, e.plots );
+		if ( added < 0)
+			return -1;
+	}
+	if ( hg->num_pending )
+		resolve_pending_partials( hg );
+	return 0;
+}
+
+
+// Parses log entries that look like this:
+// 2025-11-26T22:26:23.974 2.5.7 harvester chia.harvester.harvester: INFO     challenge_hash: 1d87c10291 ...2 plots were eligible for farming challengeFound 0 V1 proofs and 0 V2 qualities. Time: 0.07465 s. Total 252 plots
+// Or the layouts of older versions, see grammar.c
+
+// NOTE: If followed by a line that looks like: "Submitting partial for" then it was a pooled proof.
+
+int hg_feed_line( harvestgraph_t* hg, const char* line, size_t length )
+{
+	int matched = 0;
+	int result = 0;
+	if ( length > 60 )
+	{
+		const char* from_harvester = strstr( line, " harvester " );
+		const char* from_farmer    = strstr( line, " farmer " );
+		if ( from_farmer )
+			hg->has_access_to_farmer_log = 1;
+		if ( from_harvester && strstr( line, "eligible" ) )
+		{
+			harvline_t hl;
+			if ( grammar_match( &hg->grammars, line, &hg->grammar, &hl ) >= 0 )
+			{
+				// Several checks can be logged in the same second, so we keep the milliseconds,
+				// and tell entries apart by their challenge hash.
+				entry_t e;
+				e.t = log_stamp( hg, hl.year, hl.month, hl.day, hl.hours, hl.minut, hl.secon );
+				e.hash = strtoull( hl.hash, 0, 16 );
+				e.eligi = hl.eligi;
+				e.proof = hl.proof;
+				e.plots = hl.plots;
+				e.durat = hl.durat;
+				reorder_push( &hg->reorder, &e );
+				if ( hg->has_access_to_farmer_log )
+					splat_harvester( &hg->splat, splat_hash( hl.hash ), e.t );
+				matched = 1;
+				hg->newest_seen = e.t > hg->newest_seen ? e.t : hg->newest_seen;
+				result = commit_entries( hg, hg->newest_seen - REORDER_SLACK_MS );
+			}
+		}
+		// We assume that the farmer logs the signage points that it sends to its harvesters, with the challenge hash:
+		// 2025-11-26T22:26:23.512 2.5.7 farmer chia.farmer.farmer_api: INFO     New signage point 12/64 challenge_hash: 0x1d87c10291...
+		const char* chall = from_farmer && strstr( line, "signage point" ) ? strstr( line, "challenge_hash" ) : 0;
+		if ( chall )
+		{
+			int year=-1;
+			int month=-1;
+			int day=-1;
+			int hours=-1;
+			int minut=-1;
+			float secon=-1;
+			const int num = sscanf
+			(
+				line,
+				"%04d-%02d-%02dT%02d:%02d:%f",
+				&year,
+				&month,
+				&day,
+				&hours,
+				&minut,
+				&secon
+			);
+			chall += strlen( "challenge_hash" );
+			while ( *chall == ':' || *chall == ' ' || *chall == '=' )
+				chall++;
+			if ( num == 6 )
+			{
+				splat_signage_point( &hg->splat, splat_hash( chall ), log_stamp( hg, year, month, day, hours, minut, secon ) );
+				matched = 1;
+			}
+		}
+		if ( from_farmer && strstr(line, "Submitting partial for") )
+		{
+			// Last proof we found was a pooled proof.
+			// We should record this fact.
+			int year=-1;
+			int month=-1;
+			int day=-1;
+			int hours=-1;
+			int minut=-1;
+			float secon=-1;
+			const int num = sscanf
+			(
+				line,
+				"%04d-%02d-%02dT%02d:%02d:%f farmer ",
+				&year,
+				&month,
+				&day,
+				&hours,
+				&minut,
+				&secon
+			);
+			if ( num == 6 )
+			{
+				const stamp_t logtim = log_stamp( hg, year, month, day, hours, minut, secon );
+				mark_proof_as_a_pool_proof( hg, logtim );
+				matched = 1;
+			}
+		}
+	}
+	if ( matched )
+		hg->matched += 1;
+	else
+		hg->rejected += 1;
+	return result < 0 ? -1 : matched;
+}
+
+
+// Feeds the len bytes at s, in the carry buffer, as a line.
+static int feed_carry( harvestgraph_t* hg, char* s, size_t len )
+{
+	const char c = s[ len ];
+	s[ len ] = 0;
+	const int r = hg_feed_line( hg, s, len );
+	s[ len ] = c;
+	return r;
+}
+
+
+int hg_feed_bytes( harvestgraph_t* hg, const char* data, size_t len )
+{
+	if ( hg->carrylen + len + 1 > hg->carrysz )
+	{
+		const size_t sz = 2 * ( hg->carrylen + len + 1 );
+		char* carry = (char*) realloc( hg->carry, sz );
+		if ( !carry )
+			return -1;
+		hg->carry = carry;
+		hg->carrysz = sz;
+	}
+	memcpy( hg->carry + hg->carrylen, data, len );
+	size_t scanned = hg->carrylen;
+	size_t start = 0;	// Start of the first line that was not fed yet.
+	hg->carrylen += len;
+	int numl = 0;
+	int r = 0;
+	const char* nl;
+	while ( r >= 0 && ( nl = (const char*) memchr( hg->carry + scanned, '\n', hg->carrylen - scanned ) ) )
+	{
+		const size_t end = nl - hg->carry + 1;
+		r = feed_carry( hg, hg->carry + start, end - start );
+		numl++;
+		start = scanned = end;
+	}
+	// Only the incomplete last line is kept, which moves to the front once, and not after every line.
+	hg->carrylen -= start;
+	memmove( hg->carry, hg->carry + start, hg->carrylen );
+	return r < 0 ? -1 : numl;
+}
+
+
+void hg_new_source( harvestgraph_t* hg )
+{
+	hg->grammar = -1;	// A file from an older version can be next, when reading the rotated logs.
+	hg->carrylen = 0;
+}
+
+
+int hg_caught_up( harvestgraph_t* hg, int64_t now )
+{
+	// Whatever is older than the slack, will not be overtaken anymore.
+	return commit_entries( hg, now - REORDER_SLACK_MS );
+}
+
+
+int hg_end_of_input( harvestgraph_t* hg )
+{
+	const size_t len = hg->carrylen;
+	hg->carrylen = 0;
+	if ( len && feed_carry( hg, hg->carry, len ) < 0 )
+		return -1;
+	return commit_entries( hg, hg->newest_seen );	// Nothing can overtake these anymore.
+}
+
+
+int hg_add_entry( harvestgraph_t* hg, const hg_entry_t* e, int farmplots )
+{
+	return add_entry( hg, e->t, e->eligi, e->proof, 0, e->durat, farmplots, e->plots );
+}
+
+
+typedef struct importer
+{
+	harvestgraph_t*	hg;
+	stamp_t		after;
+	stamp_t		last;
+	int		failed;
+} importer_t;
+
+
+static void import_entry( void* user, stamp_t t, int eligi, int proof, int poolpr, float durat, int plots )
+{
+	importer_t* im = (importer_t*) user;
+	if ( t <= im->after || im->failed )
+		return;
+	// An export does not know the plot count of the farm, only that of the harvester.
+	im->failed = add_entry( im->hg, t, eligi, proof, poolpr, durat, plots, plots ) < 0;
+	im->last = t > im->last ? t : im->last;
+}
+
+
+long hg_import( harvestgraph_t* hg, FILE* f, int64_t after, int64_t* last )
+{
+	importer_t im = { hg, after, after, 0 };
+	const long nrows = import_history( f, import_entry, &im );
+	hg->imported = im.last > hg->imported ? im.last : hg->imported;
+	if ( last )
+		*last = im.last;
+	return im.failed ? -1 : nrows;
+}
+
+
+harvestgraph_t* hg_create( time_t now )
+{
+	harvestgraph_t* hg = (harvestgraph_t*) calloc( 1, sizeof(harvestgraph_t) );
+	if ( !hg )
+		return 0;
+	init_quarters( hg, now );
+	plotseries_init( &hg->plotcount );
+	reorder_init( &hg->reorder );
+	splat_init( &hg->splat );
+	grammar_init( &hg->grammars );
+	rollup_init( &hg->rollup );
+	colagg_init( &hg->bins );
+	hg->aggregate = colagg_best();
+	hg->grammar = -1;
+	hg->filter = HG_DEFAULT_FILTER;
+	hg->stamphour = -1;
+	return hg;
+}
+
+
+void hg_destroy( harvestgraph_t* hg )
+{
+	if ( !hg )
+		return;
+	free( hg->plotcount.runs );
+	rollup_free( &hg->rollup );
+	free( hg->carry );
+	colagg_free( &hg->bins );
+	free( hg );
+}
+
+
+void hg_set_plot_filter( harvestgraph_t* hg, int filter )
+{
+	hg->filter = filter > 0 ? filter : HG_DEFAULT_FILTER;
+}
+
+
+void hg_on_entry( harvestgraph_t* hg, hg_entry_fn fn, void* user )
+{
+	hg->on_entry = fn;
+	hg->entry_user = user;
+}
+
+
+void hg_on_partial( harvestgraph_t* hg, hg_partial_fn fn, void* user )
+{
+	hg->on_partial = fn;
+	hg->partial_user = user;
+}
+
+
+int hg_column_entries( const harvestgraph_t* hg, int col, time_t* timelo )
+{
+	const quarterhr_t* q = hg->quarters + MAXHIST-1-col;
+	if ( timelo )
+		*timelo = q->timelo;
+	return q->sz;
+}
+
+
+void hg_column( const harvestgraph_t* hg, int col, hg_column_t* c )
+{
+	const quarterhr_t* q = hg->quarters + MAXHIST-1-col;
+	memset( c, 0, sizeof(hg_column_t) );
+	c->timelo = q->timelo;
+	c->checks = q->sz;
+	double total = 0.0;
+	int numeligible = 0;
+	for ( int i=0; i<q->sz; ++i )
+	{
+		c->eligible += q->eligib[ i ];
+		c->proofs   += q->proofs[ i ];
+		c->poolpr   += q->poolpr[ i ];
+		if ( q->eligib[ i ] > 0 )
+		{
+			total += q->durati[ i ];
+			numeligible += 1;
+			c->max_lookup = q->durati[ i ] > c->max_lookup ? q->durati[ i ] : c->max_lookup;
+		}
+	}
+	c->avg_lookup = numeligible ? (float) ( total / numeligible ) : 0.0f;
+	c->eff_observed = q->eff.observed;
+	c->eff_expected = q->eff.expected;
+	c->eff_variance = q->eff.variance;
+}
+
+
+void hg_stats( const harvestgraph_t* hg, hg_stats_t* st )
+{
+	memset( st, 0, sizeof(hg_stats_t) );
+	st->newest_stamp = hg->newest_stamp;
+	st->oldest_stamp = hg->oldeststamp;
+	st->entries = hg->entries_added;
+	st->plots = hg->plotcount.latest;
+	st->plots_missing = plotseries_missing( &hg->plotcount );
+	st->plot_runs = hg->plotcount.sz;
+	st->avg_check = hg->total_eligible_responses ? hg->total_response_time_eligible / hg->total_eligible_responses : 0.0;
+	st->worst_check = hg->worst_response_time_eligible;
+	st->farmer_log = hg->has_access_to_farmer_log;
+	st->pool_proofs = hg->pool_proof_seen;
+	st->matched = hg->matched;
+	st->rejected = hg->rejected;
+	st->shifts = hg->shifts;
+	st->bad_stamp = hg->bad_stamp;
+	st->bad_slot_end = hg->quarters[ MAXHIST-1 ].timehi;
+}
+
+
+int hg_sp_latency( const harvestgraph_t* hg, time_t from, time_t to, int pct )
+{
+	return splat_percentile( &hg->splat, from, to, pct, 0 );
+}
+
+
+int hg_effectiveness( const harvestgraph_t* hg, time_t from, float* ratio, float* lo, float* hi )
+{
+	// Adds up the observed and expected eligible plots of the quarters that start at or after from.
+	farmeff_t fe;
+	memset( &fe, 0, sizeof(farmeff_t) );
+	for ( int s=MAXHIST-1; s>=0 && hg->quarters[ s ].timelo >= from; --s )
+		farmeff_merge( &fe, &hg->quarters[ s ].eff );
+	return farmeff_estimate( &fe, ratio, lo, hi );
+}
+
+
+static void fill_day( hg_day_t* hd, const dayroll_t* d, const uint32_t* hist, time_t from, time_t until )
+{
+	hd->start = d->start;
+	rollup_uptime( d, from, until, &hd->up_quarters, &hd->quarters );
+	hd->checks = d->checks;
+	hd->eligible = d->eligible;
+	hd->proofs = d->proofs;
+	hd->partials = d->partials;
+	hd->lookup_p50 = rollup_percentile( hist, 50 );
+	hd->lookup_p95 = rollup_percentile( hist, 95 );
+	hd->lookup_p99 = rollup_percentile( hist, 99 );
+	hd->lookup_max = hd->lookup_p50 < 0 ? -1 : (int) ( d->max_lookup * 1000 + 0.5f );
+	hd->plots_first = d->plots_first;
+	hd->plots_last = d->plots_last;
+	hd->plots_min = d->plots_min;
+	hd->plots_max = d->plots_max;
+	hd->plot_changes = d->plot_changes;
+	hd->plot_drops = d->plot_drops;
+}
+
+
+int hg_days( const harvestgraph_t* hg, hg_day_t* days, int max, time_t until, hg_day_t* total )
+{
+	const dayroll_t* d[ ROLLUP_DAYS ];
+	const int n = rollup_days( &hg->rollup, d, max < ROLLUP_DAYS ? max : ROLLUP_DAYS );
+	// Uptime counts whole quarter-hours, from the first one that we saw all of.
+	const time_t from = ( hg->rollup.first + 899 ) / 900 * 900;
+	for ( int i=0; i<n; ++i )
+		fill_day( days + i, d[ i ], d[ i ]->lookup, from, until );
+	if ( !total )
+		return n;
+
+	// The sums of the days, with the percentiles from their merged histograms.
+	dayroll_t sum;
+	memset( &sum, 0, sizeof(sum) );
+	sum.plots_first = -1;
+	sum.plots_last = -1;
+	sum.plots_min = -1;
+	sum.plots_max = -1;
+	int up = 0;
+	int quarters = 0;
+	for ( int i=0; i<n; ++i )
+	{
+		sum.checks += d[ i ]->checks;
+		sum.eligible += d[ i ]->eligible;
+		sum.proofs += d[ i ]->proofs;
+		sum.partials += d[ i ]->partials;
+		sum.plot_changes += d[ i ]->plot_changes;
+		sum.plot_drops += d[ i ]->plot_drops;
+		sum.max_lookup = d[ i ]->max_lookup > sum.max_lookup ? d[ i ]->max_lookup : sum.max_lookup;
+		for ( int b=0; b<ROLLUP_BINS; ++b )
+			sum.lookup[ b ] += d[ i ]->lookup[ b ];
+		if ( d[ i ]->plots_first >= 0 )
+		{
+			sum.plots_first = sum.plots_first < 0 ? d[ i ]->plots_first : sum.plots_first;
+			sum.plots_last = d[ i ]->plots_last;
+			sum.plots_min = sum.plots_min < 0 || d[ i ]->plots_min < sum.plots_min ? d[ i ]->plots_min : sum.plots_min;
+			sum.plots_max = d[ i ]->plots_max > sum.plots_max ? d[ i ]->plots_max : sum.plots_max;
+		}
+		up += days[ i ].up_quarters;
+		quarters += days[ i ].quarters;
+	}
+	sum.start = n ? d[ 0 ]->start : 0;
+	sum.end = n ? d[ n-1 ]->end : 0;
+	fill_day( total, &sum, sum.lookup, from, until );
+	total->up_quarters = up;
+	total->quarters = quarters;
+	return n;
+}
+
+
+
+int hg_save_days( const harvestgraph_t* hg, FILE* f )
+{
+	return rollup_save( &hg->rollup, f );
+}
+
+
+int hg_load_days( harvestgraph_t* hg, FILE* f, int64_t* last )
+{
+	const int n = rollup_load( &hg->rollup, f );
+	if ( last )
+		*last = hg->rollup.newest_check;
+	return n;
+}
+
+void hg_grammar_format( const harvestgraph_t* hg, char* s, size_t sz )
+{
+	grammar_format( &hg->grammars, s, sz );
+}
+
+
+void hg_grammar_dump( const harvestgraph_t* hg, FILE* f )
+{
+	grammar_dump( &hg->grammars, f );
+}
+
+
+long hg_export( const harvestgraph_t* hg, FILE* f, int binary, time_t from, time_t to )
+{
+	return export_history( hg->quarters, f, binary ? EXPORT_BIN : EXPORT_CSV, from, to );
+}
+
+
+static uint32_t pack_rgb( uint32_t red, uint32_t grn, uint32_t blu )
+{
+	return (0xffu<<24) | (blu<<16) | (grn<<8) | (red<<0);
+}
+
+
+int hg_draw_column( harvestgraph_t* hg, int nr, uint32_t* img, int stride, int h, time_t now, const hg_palette_t* pal )
+{
+	const int q = MAXHIST-1-nr;
+	if ( q<0 || h<=0 )
+		return 0;
+	// The mapping from pixel rows to time only depends on the height, so we compute it when the height changes.
+	if ( h != hg->bins.h && colagg_setup( &hg->bins, h ) )
+		return 0;
+	const quarterhr_t* quarters = hg->quarters;
+	const colagg_t* bins = &hg->bins;
+	const int* binoff = bins->binoff;
+	int changed = 0;
+	const stamp_t qlo = (stamp_t) quarters[q].timelo * 1000;
+	hg->aggregate( &hg->bins, quarters[q].stamps, quarters[q].eligib, quarters[q].proofs, quarters[q].poolpr, quarters[q].sz, qlo );
+	const int band = ( ( qlo / 900000 / 4 ) & 1 );
+	const uint32_t* lut = pal->ramp[ band ];
+	for ( int y=0; y<h; ++y )
+	{
+		const stamp_t r0 = qlo + binoff[ bins->wy0[ y ] ];
+		const stamp_t r1 = qlo + binoff[ bins->wy1[ y ] ];
+		const stamp_t s0 = qlo + binoff[ y+0 ];
+		const stamp_t s1 = qlo + binoff[ y+1 ];
+		const int checks = bins->checks[ y ];
+		const int proofs = bins->proofs[ y ];
+		const float span = ( r1 - r0 ) / 1000.0f;
+		const float nominalcheckspersecond = 9.375f;
+		const float nominalsecondspercheck = 1 / nominalcheckspersecond;
+		const float expected = span * nominalsecondspercheck;
+		float achieved = 0.73f * checks / expected;
+		achieved = achieved > 1.0f ? 1.0f : achieved;
+		const uint8_t idx = (uint8_t) ( achieved * 255 );
+		uint32_t c = lut[ idx ];
+		if ( s0 < hg->oldeststamp || s1 > now * 1000 )
+			c = pal->grey[ band ];
+		const int plotchange = plotseries_change_in( &hg->plotcount, s0 / 1000, s1 / 1000 );
+		if ( plotchange < 0 )
+		{
+			// Plots went missing here, maybe a drive fell off the bus. Show in magenta.
+			c = pack_rgb( 0xff, 0x00, 0xff );
+		}
+		if ( plotchange > 0 )
+		{
+			// Plots came back. Show in green.
+			c = pack_rgb( 0x00, 0xff, 0x60 );
+		}
+		if ( proofs )
+		{
+			// Eureka! We found a proof, and will probably get paid sweet XCH!
+			if ( !hg->pool_proof_seen )
+			{
+				// We didn't see pool proofs... this must be a solo proof. Show in dark blue.
+				c = pack_rgb( 0x40, 0x40, 0xff );
+			}
+			else
+			{
+				// We get pool proofs. This can't be a solo proof. Show in cyan.
+				c = pack_rgb( 0x20, 0xe0, 0xe0 );
+			}
+		}
+		changed |= img[ y*stride ] != c;
+		img[ y*stride ] = c;
+	}
+	return changed;
+}
+
@@ -0,0 +1,177 @@
+// harvestgraph.h
+//
+// by Abraham Stolk.
+
+// libharvestgraph: the engine of chiaharvestgraph, without the terminal.
+//
+// A harvestgraph_t holds a week of harvest history, and all that is needed to build it from the lines of Chia logs.
+// The library has no global state. Contexts are independent of each other, and can be used from different threads
+// without any locking, as long as one context is not used by two threads at the same time.
+//
+// The library never prints: what goes wrong, shows in the return values and in hg_stats().
+//
+// Feed a context log lines (or just bytes) and query it for the aggregates of its quarter-hour columns, or have it
+// draw them. Column 0 is the current quarter-hour, column HG_NUM_COLUMNS-1 the oldest.
+// Stamps are in milliseconds since the epoch, other times in seconds since the epoch.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define HG_NUM_COLUMNS		( 4 * 24 * 7 )	// A week's worth of quarter-hours.
+#define HG_DEFAULT_FILTER	512		// One in this many plots passes the plot filter.
+#define HG_MAX_DAYS		400		// Days of totals that are kept.
+
+typedef struct harvestgraph harvestgraph_t;
+
+typedef struct hg_entry
+{
+	int64_t		t;		// When the harvester was done with the check.
+	int		eligi;		// Nr of plots that passed the filter.
+	int		proof;		// Nr of proofs found.
+	float		durat;		// Lookup time, in seconds.
+	int		plots;		// Plot count of the harvester that did the check.
+} hg_entry_t;
+
+typedef struct hg_column
+{
+	int64_t		timelo;		// Start of the quarter-hour.
+	int		checks;
+	int		eligible;
+	int		proofs;
+	int		poolpr;		// Proofs that were submitted as pool partials.
+	float		avg_lookup;	// Average lookup time of checks with eligible plots, in seconds. 0 if none.
+	float		max_lookup;
+	int		eff_observed;	// Eligible plots of the checks that reported a plot count.
+	float		eff_expected;	// Eligible plots expected from those plot counts.
+	float		eff_variance;	// Variance of eff_observed, if every plot is searched.
+} hg_column_t;
+
+typedef struct hg_stats
+{
+	int64_t		newest_stamp;	// Stamp of the latest entry in the history, 0 if none.
+	int64_t		oldest_stamp;	// Stamp of the oldest entry that was ever added.
+	int		entries;	// Nr of entries that were added to the history.
+	int		plots;		// Latest plot count of the farm, -1 if not known.
+	int		plots_missing;	// How many plots went missing since the count was highest.
+	int		plot_runs;	// Nr of plot count changes in the history.
+	double		avg_check;	// Average lookup time of checks with eligible plots, in seconds.
+	double		worst_check;	// Slowest lookup time of checks with eligible plots, in seconds.
+	int		farmer_log;	// Did we see lines from the farmer?
+	int		pool_proofs;	// Did we see pool partials?
+	uint64_t	matched;	// Lines that gave us something.
+	uint64_t	rejected;	// Lines that we had no use for.
+	uint64_t	shifts;		// Times that the history scrolled by a quarter-hour.
+	int64_t		bad_stamp;	// The entry that made a call fail with -1, because it did not fit in the history. 0 if none.
+	int64_t		bad_slot_end;	// The end of the history, in seconds, to go with it.
+} hg_stats_t;
+
+// Totals of a local day.
+typedef struct hg_day
+{
+	int64_t		start;		// Local midnight.
+	int		up_quarters;	// Quarter-hours with a nominal nr of checks.
+	int		quarters;	// Quarter-hours that we have seen all of.
+	int		checks;
+	int		eligible;
+	int		proofs;
+	int		partials;	// Pool partials that the farmer submitted.
+	int		lookup_p50;	// Lookup times of checks with eligible plots, in ms. -1 if there were none.
+	int		lookup_p95;
+	int		lookup_p99;
+	int		lookup_max;
+	int		plots_first;	// Plot count of the farm at the start of the day, -1 if not known.
+	int		plots_last;
+	int		plots_min;
+	int		plots_max;
+	int		plot_changes;	// How often the plot count changed.
+	int		plot_drops;	// How many of those were drops.
+} hg_day_t;
+
+// Colours are packed as 0xAABBGGRR. Every other hour is drawn with the second ramp, and grey means "no data".
+typedef struct hg_palette
+{
+	uint32_t	ramp[ 2 ][ 256 ];	// From no checks, to all the checks that we expect.
+	uint32_t	grey[ 2 ];
+} hg_palette_t;
+
+// Called for every entry that goes into the history, with the plot count of the whole farm.
+typedef void (*hg_entry_fn)( void* user, const hg_entry_t* e, int farmplots );
+
+// Called for every pool partial that the farmer submitted.
+typedef void (*hg_partial_fn)( void* user, int64_t t );
+
+
+extern harvestgraph_t* hg_create( time_t now );
+
+extern void hg_destroy( harvestgraph_t* hg );
+
+extern void hg_set_plot_filter( harvestgraph_t* hg, int filter );
+
+extern void hg_on_entry( harvestgraph_t* hg, hg_entry_fn fn, void* user );
+
+extern void hg_on_partial( harvestgraph_t* hg, hg_partial_fn fn, void* user );
+
+
+// Feeds one line, as a C string of len bytes, with or without its newline.
+// Returns 1 if the line was used, 0 if not, and -1 if its time stamp makes no sense: see bad_stamp of hg_stats().
+extern int  hg_feed_line( harvestgraph_t* hg, const char* line, size_t len );
+
+// Feeds bytes as they come, cut anywhere. An incomplete last line is kept until the rest comes in.
+// Returns the nr of lines fed, or -1 like hg_feed_line().
+extern int  hg_feed_bytes( harvestgraph_t* hg, const char* data, size_t len );
+
+// Tells that the next lines come from another file, which may have been written by another version of Chia.
+extern void hg_new_source( harvestgraph_t* hg );
+
+// Tells that all there is to read, has been fed. Entries that can not be overtaken anymore go into the history.
+extern int  hg_caught_up( harvestgraph_t* hg, int64_t now );
+
+// Tells that there will be no more lines. All entries go into the history.
+extern int  hg_end_of_input( harvestgraph_t* hg );
+
+// Adds the entries of a file that hg_export() wrote, that are newer than after (in ms). Returns how many, or -1.
+// The stamp of the last one goes in *last, so that a next file that overlaps with this one, can skip what we had.
+// Entries and partials up to that stamp, that come in from the logs afterwards, are skipped as well.
+extern long hg_import( harvestgraph_t* hg, FILE* f, int64_t after, int64_t* last );
+
+// Adds an entry that was parsed elsewhere, like by a remote agent. Returns 1 if added, 0 if not, -1 on failure.
+extern int  hg_add_entry( harvestgraph_t* hg, const hg_entry_t* e, int farmplots );
+
+
+// Nr of entries in a column, and the start of its quarter-hour. Cheap, to see if a column changed.
+extern int  hg_column_entries( const harvestgraph_t* hg, int col, time_t* timelo );
+
+extern void hg_column( const harvestgraph_t* hg, int col, hg_column_t* c );
+
+extern void hg_stats( const harvestgraph_t* hg, hg_stats_t* st );
+
+// The pct-th percentile of the signage point latency over [from,to), in ms. -1 if there were none.
+extern int  hg_sp_latency( const harvestgraph_t* hg, time_t from, time_t to, int pct );
+
+// Eligible plots, observed vs expected, since time from. Returns 0 if there is too little to go on.
+extern int  hg_effectiveness( const harvestgraph_t* hg, time_t from, float* ratio, float* lo, float* hi );
+
+// The newest max days, oldest first, and optionally their total. Quarter-hours up to until count for the uptime.
+// The days are added up as entries come in, and go back further than the columns, so this is cheap. Returns the nr of days.
+extern int  hg_days( const harvestgraph_t* hg, hg_day_t* days, int max, time_t until, hg_day_t* total );
+
+// Writes the days, so that they outlive the logs, and a report does not need to read the logs again. Returns -1 on failure.
+extern int  hg_save_days( const harvestgraph_t* hg, FILE* f );
+
+// Reads the days that hg_save_days() wrote, before any entries go in. Entries that those days already hold, are not counted
+// again when they come in. The stamp of the newest check that they hold goes in *last, in ms. Returns the nr of days, or -1.
+extern int  hg_load_days( harvestgraph_t* hg, FILE* f, int64_t* last );
+
+// Hit and miss counts of the log line grammars.
+extern void hg_grammar_format( const harvestgraph_t* hg, char* s, size_t sz );
+
+extern void hg_grammar_dump( const harvestgraph_t* hg, FILE* f );
+
+// Writes the entries of [from,to) as CSV, or in the columnar format of export.h. Returns the nr of entries, or -1.
+extern long hg_export( const harvestgraph_t* hg, FILE* f, int binary, time_t from, time_t to );
+
+
+// Draws a column into h pixels, that are stride pixels apart. Returns 1 if any pixel changed.
+extern int  hg_draw_column( harvestgraph_t* hg, int col, uint32_t* pixels, int stride, int h, time_t now, const hg_palette_t* pal );
+
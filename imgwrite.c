@@ -0,0 +1,257 @@
+// imgwrite.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "imgwrite.h"
+
+
+#define MAXSTORED	65535	// Largest block that deflate can store without compression.
+
+static uint32_t crctab[ 256 ];
+
+static uint8_t* scanline = 0;
+static size_t scanlinesz = 0;
+
+
+static void setup_crc( void )
+{
+	for ( uint32_t n=0; n<256; ++n )
+	{
+		uint32_t c = n;
+		for ( int k=0; k<8; ++k )
+			c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+		crctab[ n ] = c;
+	}
+}
+
+
+static uint32_t crc_update( uint32_t crc, const uint8_t* p, size_t len )
+{
+	while ( len-- )
+		crc = crctab[ ( crc ^ *p++ ) & 0xff ] ^ ( crc >> 8 );
+	return crc;
+}
+
+
+static void adler_update( uint32_t* a, uint32_t* b, const uint8_t* p, size_t len )
+{
+	while ( len )
+	{
+		// Postpone the modulo for as long as the sums can not overflow.
+		size_t n = len < 5552 ? len : 5552;
+		len -= n;
+		while ( n-- )
+		{
+			*a += *p++;
+			*b += *a;
+		}
+		*a %= 65521;
+		*b %= 65521;
+	}
+}
+
+
+static void put_be32( uint8_t* dst, uint32_t v )
+{
+	dst[0] = (uint8_t) ( v >> 24 );
+	dst[1] = (uint8_t) ( v >> 16 );
+	dst[2] = (uint8_t) ( v >>  8 );
+	dst[3] = (uint8_t) ( v >>  0 );
+}
+
+
+// RGB of one row, with the PNG filter byte in front if asked for.
+static const uint8_t* convert_row( const uint32_t* src, int w, int filterbyte )
+{
+	const size_t sz = w * 3 + 1;
+	if ( sz > scanlinesz )
+	{
+		scanline = (uint8_t*) realloc( scanline, sz );
+		scanlinesz = sz;
+	}
+	uint8_t* dst = scanline;
+	if ( filterbyte )
+		*dst++ = 0;
+	for ( int x=0; x<w; ++x )
+	{
+		const uint32_t c = src[ x ];
+		*dst++ = (uint8_t) ( c >>  0 );
+		*dst++ = (uint8_t) ( c >>  8 );
+		*dst++ = (uint8_t) ( c >> 16 );
+	}
+	return scanline;
+}
+
+
+// Palette indices of one row, with the PNG filter byte in front.
+static const uint8_t* indexed_row( const uint8_t* src, int w )
+{
+	const size_t sz = w + 1;
+	if ( sz > scanlinesz )
+	{
+		scanline = (uint8_t*) realloc( scanline, sz );
+		scanlinesz = sz;
+	}
+	scanline[ 0 ] = 0;
+	memcpy( scanline + 1, src, w );
+	return scanline;
+}
+
+
+static void write_ppm( FILE* f, int w, int h, const uint32_t* rgba )
+{
+	fprintf( f, "P6\n%d %d\n255\n", w, h );
+	for ( int y=0; y<h; ++y )
+		fwrite( convert_row( rgba + y * w, w, 0 ), 3, w, f );
+}
+
+
+// Writes a chunk header, and starts the crc over its type.
+static uint32_t begin_chunk( FILE* f, const char* type, uint32_t len )
+{
+	uint8_t hdr[ 8 ];
+	put_be32( hdr, len );
+	memcpy( hdr+4, type, 4 );
+	fwrite( hdr, 1, 8, f );
+	return crc_update( 0xffffffffu, hdr+4, 4 );
+}
+
+
+static void end_chunk( FILE* f, uint32_t crc )
+{
+	uint8_t tail[ 4 ];
+	put_be32( tail, crc ^ 0xffffffffu );
+	fwrite( tail, 1, 4, f );
+}
+
+
+static void put_bytes( FILE* f, uint32_t* crc, const uint8_t* p, size_t len )
+{
+	fwrite( p, 1, len, f );
+	*crc = crc_update( *crc, p, len );
+}
+
+
+// A PNG with a single IDAT chunk, holding a zlib stream of stored (uncompressed) deflate blocks.
+// Our images are mostly flat colours that would compress well, but the point here is to be cheap to write.
+// Either rgba is given for a truecolour image, or indices (rows that are stride apart) with a palette.
+static int write_png( FILE* f, int w, int h, const uint32_t* rgba, const uint8_t* indices, int stride, const uint32_t* pal, int numpal )
+{
+	const int bpp = rgba ? 3 : 1;
+	const uint64_t rawsz = (uint64_t) h * ( w * bpp + 1 );
+	const uint64_t numblocks = ( rawsz + MAXSTORED - 1 ) / MAXSTORED;
+	const uint64_t idatsz = 2 + rawsz + 5 * numblocks + 4;
+	if ( idatsz > INT_MAX )
+		return -1;
+
+	static const uint8_t signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite( signature, 1, 8, f );
+
+	uint8_t ihdr[ 13 ];
+	put_be32( ihdr+0, w );
+	put_be32( ihdr+4, h );
+	ihdr[  8 ] = 8;		// Bit depth.
+	ihdr[  9 ] = rgba ? 2 : 3;	// Truecolour, or indexed.
+	ihdr[ 10 ] = 0;		// Deflate.
+	ihdr[ 11 ] = 0;		// Adaptive filtering, but every row uses filter 0.
+	ihdr[ 12 ] = 0;		// Not interlaced.
+	uint32_t crc = begin_chunk( f, "IHDR", sizeof(ihdr) );
+	put_bytes( f, &crc, ihdr, sizeof(ihdr) );
+	end_chunk( f, crc );
+
+	if ( !rgba )
+	{
+		crc = begin_chunk( f, "PLTE", 3 * numpal );
+		for ( int i=0; i<numpal; ++i )
+		{
+			const uint8_t rgb[ 3 ] = { (uint8_t) ( pal[i] >> 0 ), (uint8_t) ( pal[i] >> 8 ), (uint8_t) ( pal[i] >> 16 ) };
+			put_bytes( f, &crc, rgb, 3 );
+		}
+		end_chunk( f, crc );
+	}
+
+	crc = begin_chunk( f, "IDAT", (uint32_t) idatsz );
+	static const uint8_t zlibhdr[ 2 ] = { 0x78, 0x01 };
+	put_bytes( f, &crc, zlibhdr, 2 );
+	uint32_t a = 1, b = 0;
+	uint64_t left = rawsz;		// Raw bytes that still need to go out.
+	uint32_t blockleft = 0;		// Room left in the current stored block.
+	for ( int y=0; y<h; ++y )
+	{
+		const uint8_t* row = rgba ? convert_row( rgba + y * w, w, 1 ) : indexed_row( indices + y * stride, w );
+		size_t rowleft = w * bpp + 1;
+		adler_update( &a, &b, row, rowleft );
+		while ( rowleft )
+		{
+			if ( !blockleft )
+			{
+				blockleft = left < MAXSTORED ? (uint32_t) left : MAXSTORED;
+				const uint8_t blkhdr[ 5 ] =
+				{
+					left == blockleft,	// Final block?
+					(uint8_t) ( blockleft >> 0 ), (uint8_t) ( blockleft >> 8 ),
+					(uint8_t) ~( blockleft >> 0 ), (uint8_t) ~( blockleft >> 8 ),
+				};
+				put_bytes( f, &crc, blkhdr, 5 );
+			}
+			const size_t n = rowleft < blockleft ? rowleft : blockleft;
+			put_bytes( f, &crc, row, n );
+			row += n;
+			rowleft -= n;
+			blockleft -= n;
+			left -= n;
+		}
+	}
+	uint8_t adler[ 4 ];
+	put_be32( adler, ( b << 16 ) | a );
+	put_bytes( f, &crc, adler, 4 );
+	end_chunk( f, crc );
+
+	crc = begin_chunk( f, "IEND", 0 );
+	end_chunk( f, crc );
+	return ferror( f ) ? -1 : 0;
+}
+
+
+int imgwrite_save( const char* fname, int w, int h, const uint32_t* rgba )
+{
+	if ( !crctab[ 1 ] )
+		setup_crc();
+
+	char tmpname[ PATH_MAX ];
+	snprintf( tmpname, sizeof(tmpname), "%s.tmp%d", fname, (int) getpid() );
+	FILE* f = fopen( tmpname, "wb" );
+	if ( !f )
+		return -1;
+
+	const size_t len = strlen( fname );
+	const int ppm = len > 4 && !strcmp( fname + len - 4, ".ppm" );
+	int rv = 0;
+	if ( ppm )
+		write_ppm( f, w, h, rgba );
+	else
+		rv = write_png( f, w, h, rgba, 0, 0, 0, 0 );
+	// A short write, like on a full disk, may not show up in fclose(), and must not replace the previous image.
+	rv = rv || ferror( f );
+	if ( fclose( f ) || rv || rename( tmpname, fname ) )
+	{
+		unlink( tmpname );
+		return -1;
+	}
+	return 0;
+}
+
+
+int imgwrite_png_indexed( FILE* f, int w, int h, const uint8_t* indices, int stride, const uint32_t* pal, int numpal )
+{
+	if ( !crctab[ 1 ] )
+		setup_crc();
+	return write_png( f, w, h, 0, indices, stride, pal, numpal );
+}
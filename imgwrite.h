@@ -0,0 +1,12 @@
+// imgwrite.h
+//
+// by Abraham Stolk.
+
+// Saves the RGBA image as a binary PPM or an uncompressed PNG, depending on the file name.
+// The image is written to a temporary file first, and then renamed, so a reader never sees a partial file.
+
+extern int imgwrite_save( const char* fname, int w, int h, const uint32_t* rgba );
+
+// Writes a palette PNG to an open stream. Row y of the image starts at indices + y * stride.
+extern int imgwrite_png_indexed( FILE* f, int w, int h, const uint8_t* indices, int stride, const uint32_t* pal, int numpal );
+
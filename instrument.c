@@ -0,0 +1,86 @@
+// instrument.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+#include "instrument.h"
+
+
+uint64_t instr_counters[ NUMCOUNTERS ];
+
+stagetimer_t instr_stages[ NUMSTAGES ];
+
+volatile int instr_dump_requested = 0;
+
+static const char* stagenames[ NUMSTAGES ] = { "read", "draw", "print" };
+
+static const char* counternames[ NUMCOUNTERS ] = { "lines", "matched", "rejected", "frames", "bytes", "shifts" };
+
+
+static void sigusr1Handler( int sig )
+{
+	instr_dump_requested = 1;
+}
+
+
+int instr_init( void )
+{
+	// Dump the counters when someone sends us a SIGUSR1.
+	struct sigaction sa;
+	sigemptyset( &sa.sa_mask );
+	sa.sa_flags = SA_RESTART;
+	sa.sa_handler = sigusr1Handler;
+	if ( sigaction( SIGUSR1, &sa, 0 ) == -1 )
+	{
+		perror( "sigaction" );
+		return -1;
+	}
+	return 0;
+}
+
+
+// One line summary, to show in the overlay.
+void instr_format( char* s, size_t sz )
+{
+	const uint64_t frames = instr_counters[ CNT_FRAMES ];
+	snprintf
+	(
+		s, sz,
+		"LINES:%llu MATCH:%llu REJ:%llu READ:%.1fms DRAW:%.2fms PRINT:%.2fms OUT:%lluB/FRAME SHIFTS:%llu",
+		(unsigned long long) instr_counters[ CNT_LINES ],
+		(unsigned long long) instr_counters[ CNT_MATCHED ],
+		(unsigned long long) instr_counters[ CNT_REJECTED ],
+		instr_stages[ STAGE_READ  ].ns * 1e-6,
+		instr_stages[ STAGE_DRAW  ].last_ns * 1e-6,
+		instr_stages[ STAGE_PRINT ].last_ns * 1e-6,
+		(unsigned long long) ( frames ? instr_counters[ CNT_BYTES ] / frames : 0 ),
+		(unsigned long long) instr_counters[ CNT_SHIFTS ]
+	);
+}
+
+
+void instr_dump( FILE* f )
+{
+	for ( int c=0; c<NUMCOUNTERS; ++c )
+		fprintf( f, "%-10s %llu\n", counternames[ c ], (unsigned long long) instr_counters[ c ] );
+	for ( int st=0; st<NUMSTAGES; ++st )
+	{
+		const stagetimer_t* t = instr_stages + st;
+		fprintf
+		(
+			f,
+			"%-10s calls=%llu total=%.3fms avg=%.3fms last=%.3fms\n",
+			stagenames[ st ],
+			(unsigned long long) t->calls,
+			t->ns * 1e-6,
+			t->calls ? t->ns * 1e-6 / t->calls : 0.0,
+			t->last_ns * 1e-6
+		);
+	}
+	fflush( f );
+}
+
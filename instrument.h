@@ -0,0 +1,71 @@
+// instrument.h
+//
+// by Abraham Stolk.
+
+// Cheap counters and stage timers, to see what the tool itself costs.
+// Compiled in by default. Build with -DNO_INSTRUMENTATION to leave them out.
+
+enum
+{
+	STAGE_READ=0,		// read_log_file()
+	STAGE_DRAW,		// draw_column() for all columns.
+	STAGE_PRINT,		// print_image_double_res()
+	NUMSTAGES
+};
+
+enum
+{
+	CNT_LINES=0,		// Lines read from the log.
+	CNT_MATCHED,		// Lines that gave us a harvester entry or a pool partial.
+	CNT_REJECTED,		// Lines that we had no use for.
+	CNT_FRAMES,		// Images sent to the terminal.
+	CNT_BYTES,		// Bytes sent to the terminal.
+	CNT_SHIFTS,		// Times the history scrolled by a quarter.
+	NUMCOUNTERS
+};
+
+typedef struct stagetimer
+{
+	uint64_t	ns;		// Total time spent in stage.
+	uint64_t	calls;
+	uint64_t	last_ns;	// Time spent in stage, last time.
+} stagetimer_t;
+
+extern uint64_t instr_counters[ NUMCOUNTERS ];
+
+extern stagetimer_t instr_stages[ NUMSTAGES ];
+
+extern volatile int instr_dump_requested;
+
+extern int instr_init( void );
+
+extern void instr_format( char* s, size_t sz );
+
+extern void instr_dump( FILE* f );
+
+
+#if !defined(NO_INSTRUMENTATION)
+
+static inline uint64_t instr_now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define INSTR_COUNT( c, n )	( instr_counters[ (c) ] += (n) )
+
+#define INSTR_BEGIN( v )	const uint64_t v = instr_now()
+
+#define INSTR_END( stage, v )	do { const uint64_t d_ = instr_now() - (v); instr_stages[ (stage) ].ns += d_; instr_stages[ (stage) ].last_ns = d_; instr_stages[ (stage) ].calls += 1; } while(0)
+
+#else
+
+#define INSTR_COUNT( c, n )	((void)0)
+
+#define INSTR_BEGIN( v )	((void)0)
+
+#define INSTR_END( stage, v )	((void)0)
+
+#endif
+
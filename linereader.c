@@ -0,0 +1,103 @@
+// linereader.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "linereader.h"
+
+
+int linereader_init( linereader_t* lr, int fd, size_t cap )
+{
+	memset( lr, 0, sizeof(linereader_t) );
+	lr->fd = fd;
+	lr->cap = cap;
+	lr->buf = (char*) malloc( cap + 1 );
+	if ( !lr->buf )
+		return -1;
+	const int flags = fcntl( fd, F_GETFL, 0 );
+	return fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+}
+
+
+// Cuts the complete lines out of buf[0,len), and moves what is left to the front.
+static int slice_lines( linereader_t* lr, linereader_fn fn )
+{
+	int numl = 0;
+	char* s = lr->buf;
+	char* end = lr->buf + lr->len;
+	char* nl;
+	while ( ( nl = (char*) memchr( s, '\n', end - s ) ) )
+	{
+		*nl = 0;
+		if ( lr->skipping )
+			lr->skipping = 0;	// That was the tail of a line that was too long.
+		else
+		{
+			fn( s, nl - s + 1 );
+			numl++;
+		}
+		s = nl + 1;
+	}
+	lr->len = end - s;
+	if ( lr->len == lr->cap )
+	{
+		// No newline in a full buffer. Drop this line, up to its newline.
+		if ( !lr->skipping )
+			lr->dropped += 1;
+		lr->skipping = 1;
+		lr->len = 0;
+	}
+	else if ( lr->len && s != lr->buf )
+		memmove( lr->buf, s, lr->len );
+	return numl;
+}
+
+
+int linereader_pump( linereader_t* lr, size_t budget, linereader_fn fn )
+{
+	int numl = 0;
+	size_t total = 0;
+	lr->caughtup = 0;
+	while ( total < budget && !lr->eof )
+	{
+		const ssize_t n = read( lr->fd, lr->buf + lr->len, lr->cap - lr->len );
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			if ( errno != EAGAIN && errno != EWOULDBLOCK )
+			{
+				perror( "read() failed" );
+				lr->eof = 1;
+			}
+			lr->caughtup = 1;
+			return numl;
+		}
+		if ( n == 0 )
+		{
+			// The writer is gone. A last line without a newline still counts.
+			lr->eof = 1;
+			lr->caughtup = 1;
+			if ( lr->len && !lr->skipping )
+			{
+				lr->buf[ lr->len ] = 0;
+				fn( lr->buf, lr->len );
+				numl++;
+			}
+			lr->len = 0;
+			return numl;
+		}
+		total += n;
+		lr->len += n;
+		numl += slice_lines( lr, fn );
+	}
+	return numl;
+}
+
@@ -0,0 +1,33 @@
+// linereader.h
+//
+// by Abraham Stolk.
+
+// Reads lines from a pipe or FIFO, like the output of journalctl -f, without blocking.
+//
+// Data is read in large chunks, straight into one buffer, and cut into lines where it lies: the newline is replaced
+// by a NUL, so that the line can be used as a C string, without a copy. Only an incomplete last line gets moved to
+// the front of the buffer, to wait for the rest.
+//
+// A pump reads no more than its budget. Whatever it leaves in the pipe, stays there: the writer blocks when the pipe
+// is full, and we are never further behind than one pipe's worth. Lines longer than the buffer are dropped.
+
+typedef struct linereader
+{
+	int		fd;
+	char*		buf;
+	size_t		cap;
+	size_t		len;		// Bytes in buf that are not part of a complete line yet.
+	int		skipping;	// Are we dropping the rest of a line that was too long?
+	int		eof;		// Did the writer(s) go away?
+	int		caughtup;	// Did the last pump read all there was?
+	uint64_t	dropped;	// Nr of lines that were too long.
+} linereader_t;
+
+typedef void (*linereader_fn)( const char* line, ssize_t length );	// length includes the (replaced) newline.
+
+
+extern int  linereader_init( linereader_t* lr, int fd, size_t cap );
+
+// Reads what is available, up to budget bytes, and calls fn for each complete line. Returns the nr of lines.
+extern int  linereader_pump( linereader_t* lr, size_t budget, linereader_fn fn );
+
@@ -0,0 +1,126 @@
+// plotseries.c
+//
+// by Abraham Stolk.
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "plotseries.h"
+
+
+void plotseries_init( plotseries_t* ps )
+{
+	memset( ps, 0, sizeof(plotseries_t) );
+	ps->latest = -1;
+	ps->cand = -1;
+}
+
+
+static void append_run( plotseries_t* ps, time_t t, int count )
+{
+	if ( ps->sz == ps->cap )
+	{
+		ps->cap = ps->cap ? 2 * ps->cap : 16;
+		ps->runs = (plotrun_t*) realloc( ps->runs, ps->cap * sizeof(plotrun_t) );
+		assert( ps->runs );
+	}
+	int kind = 0;
+	if ( ps->sz )
+	{
+		const plotrun_t* prev = ps->runs + ps->sz - 1;
+		if ( count < prev->count )
+			kind = -1;
+		else if ( prev->kind == -1 )
+			kind = 1;	// Going up again, after going down.
+		t = t < prev->start ? prev->start : t;	// Merged streams can be a little out of order: keep the runs sorted.
+	}
+	ps->runs[ ps->sz ].start = t;
+	ps->runs[ ps->sz ].count = count;
+	ps->runs[ ps->sz ].kind  = kind;
+	ps->sz += 1;
+	ps->latest = count;
+}
+
+
+// A tiny change-point detector: a different plot count has to persist for a few checks before it is accepted.
+// This stops a single odd reading (a harvester that is busy refreshing its plots) from showing up as a drop.
+void plotseries_add( plotseries_t* ps, time_t t, int plots )
+{
+	if ( ps->latest == -1 )
+	{
+		append_run( ps, t, plots );
+		return;
+	}
+	if ( plots == ps->latest )
+	{
+		ps->candseen = 0;
+		return;
+	}
+	if ( plots != ps->cand || !ps->candseen )
+	{
+		ps->cand = plots;
+		ps->candstart = t;
+		ps->candseen = 0;
+	}
+	ps->candseen += 1;
+	if ( ps->candseen >= PLOTSERIES_CONFIRM )
+	{
+		append_run( ps, ps->candstart, plots );
+		ps->candseen = 0;
+	}
+}
+
+
+// Forget runs that are older than what we keep in the graph, but keep the one that was current at that time.
+void plotseries_trim( plotseries_t* ps, time_t oldest )
+{
+	int i = 0;
+	while ( i+1 < ps->sz && ps->runs[ i+1 ].start <= oldest )
+		++i;
+	if ( i )
+	{
+		memmove( ps->runs, ps->runs + i, ( ps->sz - i ) * sizeof(plotrun_t) );
+		ps->sz -= i;
+		ps->runs[ 0 ].kind = 0;
+	}
+}
+
+
+// Returns -1 if the plot count dropped in [t0,t1), +1 if it recovered, 0 if neither happened.
+int plotseries_change_in( const plotseries_t* ps, time_t t0, time_t t1 )
+{
+	// Binary search for first run that starts at or after t0.
+	int lo = 0;
+	int hi = ps->sz;
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( ps->runs[ mid ].start < t0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	int kind = 0;
+	for ( int i=lo; i<ps->sz && ps->runs[ i ].start < t1; ++i )
+		if ( ps->runs[ i ].kind )
+			kind = ps->runs[ i ].kind;
+	return kind;
+}
+
+
+// How many plots are we missing, compared to before the last drop?
+int plotseries_missing( const plotseries_t* ps )
+{
+	if ( ps->sz < 2 || ps->runs[ ps->sz-1 ].kind == 0 )
+		return 0;
+	int peak = 0;
+	int i = ps->sz-1;
+	while ( i > 0 && ps->runs[ i ].kind != 0 )
+		--i;
+	for ( ; i<ps->sz; ++i )
+		peak = ps->runs[ i ].count > peak ? ps->runs[ i ].count : peak;
+	return peak - ps->latest;
+}
+
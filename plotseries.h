@@ -0,0 +1,38 @@
+// plotseries.h
+//
+// by Abraham Stolk.
+
+// Run-length encoded time series of the "Total N plots" value.
+// Storage grows with the number of changes, not with the number of checks.
+
+#define PLOTSERIES_CONFIRM	3	// A new plot count must be seen this many times in a row, before we believe it.
+
+typedef struct plotrun
+{
+	time_t	start;		// When this plot count was first seen.
+	int	count;		// The plot count.
+	int	kind;		// -1 for a drop, +1 for a recovery from a drop, 0 otherwise.
+} plotrun_t;
+
+typedef struct plotseries
+{
+	plotrun_t*	runs;
+	int		sz;
+	int		cap;
+	int		latest;		// Latest confirmed plot count, or -1.
+	int		cand;		// Candidate plot count that is not confirmed yet.
+	int		candseen;	// How many times in a row we saw the candidate.
+	time_t		candstart;
+} plotseries_t;
+
+
+extern void plotseries_init( plotseries_t* ps );
+
+extern void plotseries_add( plotseries_t* ps, time_t t, int plots );
+
+extern void plotseries_trim( plotseries_t* ps, time_t oldest );
+
+extern int  plotseries_change_in( const plotseries_t* ps, time_t t0, time_t t1 );
+
+extern int  plotseries_missing( const plotseries_t* ps );
+
@@ -0,0 +1,154 @@
+// publish.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "harvestgraph.h"
+#include "publish.h"
+
+
+// The layout is a promise to the readers: make sure that it matches our history.
+typedef char assert_num_columns[ PUBLISH_QUARTERS == HG_NUM_COLUMNS ? 1 : -1 ];
+typedef char assert_quarter_size[ sizeof(publish_quarter_t) == 48 ? 1 : -1 ];
+
+static publish_segment_t* seg = 0;
+static char segname[ 256 ];
+
+static publish_quarter_t shadow[ HG_NUM_COLUMNS ];	// What we published last.
+static int pubsz[ HG_NUM_COLUMNS ];			// Nr of entries in the quarter, when we published it.
+static uint8_t changed[ HG_NUM_COLUMNS ];
+
+
+int publish_init( const char* name )
+{
+	snprintf( segname, sizeof(segname), "%s", name );
+	const int fd = shm_open( segname, O_CREAT | O_RDWR, 0644 );
+	if ( fd < 0 )
+	{
+		perror( "shm_open() failed" );
+		return -1;
+	}
+	if ( ftruncate( fd, sizeof(publish_segment_t) ) )
+	{
+		perror( "ftruncate() failed" );
+		close( fd );
+		shm_unlink( segname );
+		return -1;
+	}
+	void* addr = mmap( 0, sizeof(publish_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( addr == MAP_FAILED )
+	{
+		perror( "mmap() failed" );
+		shm_unlink( segname );
+		return -1;
+	}
+	seg = (publish_segment_t*) addr;
+
+	// A reader may still have the segment of a previous run mapped: keep it from reading while we set up.
+	const uint64_t gen = seg->magic == PUBLISH_MAGIC ? ( seg->generation | 1 ) + 1 : 1;
+	__atomic_store_n( &seg->generation, gen, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	seg->magic = PUBLISH_MAGIC;
+	seg->version = PUBLISH_VERSION;
+	seg->segment_size = sizeof(publish_segment_t);
+	seg->quarter_size = sizeof(publish_quarter_t);
+	seg->num_quarters = PUBLISH_QUARTERS;
+	seg->pid = (int32_t) getpid();
+	seg->updated = 0;
+	seg->newest_stamp = 0;
+	seg->plots = -1;
+	seg->plots_missing = 0;
+	seg->alerts_firing = 0;
+	seg->reserved = 0;
+	memset( seg->quarters, 0, sizeof(seg->quarters) );
+	__atomic_store_n( &seg->generation, gen + 1, __ATOMIC_RELEASE );
+
+	memset( shadow, 0, sizeof(shadow) );
+	memset( pubsz, -1, sizeof(pubsz) );
+	atexit( publish_exit );
+	fprintf( stderr, "Publishing harvest stats in shared memory %s\n", segname );
+	return 0;
+}
+
+
+void publish_update( const harvestgraph_t* hg, int firing )
+{
+	if ( !seg )
+		return;
+
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	const int64_t newest = st.newest_stamp;
+	const int plots = st.plots;
+	const int missing = st.plots_missing;
+
+	// Only quarters that got entries, or shifted, need a new aggregate.
+	// The last two are always redone, as pool partials get matched to their proofs a little later.
+	int numchanged = 0;
+	for ( int s=0; s<HG_NUM_COLUMNS; ++s )
+	{
+		const int col = HG_NUM_COLUMNS-1-s;
+		time_t timelo;
+		const int sz = hg_column_entries( hg, col, &timelo );
+		changed[ s ] = 0;
+		if ( timelo == shadow[ s ].timelo && sz == pubsz[ s ] && s < HG_NUM_COLUMNS-2 )
+			continue;
+		hg_column_t c;
+		hg_column( hg, col, &c );
+		publish_quarter_t pq;
+		memset( &pq, 0, sizeof(publish_quarter_t) );
+		pq.timelo = c.timelo;
+		pq.checks = c.checks;
+		pq.eligible = c.eligible;
+		pq.proofs = c.proofs;
+		pq.poolpr = c.poolpr;
+		pq.avg_lookup = c.avg_lookup;
+		pq.max_lookup = c.max_lookup;
+		pq.eff_observed = c.eff_observed;
+		pq.eff_expected = c.eff_expected;
+		pq.eff_variance = c.eff_variance;
+		pubsz[ s ] = sz;
+		if ( memcmp( &pq, shadow + s, sizeof(pq) ) )
+		{
+			shadow[ s ] = pq;
+			changed[ s ] = 1;
+			numchanged++;
+		}
+	}
+	if ( !numchanged && newest == seg->newest_stamp && plots == seg->plots && missing == seg->plots_missing && firing == seg->alerts_firing )
+		return;
+
+	const uint64_t gen = seg->generation;
+	__atomic_store_n( &seg->generation, gen + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	for ( int s=0; s<HG_NUM_COLUMNS; ++s )
+		if ( changed[ s ] )
+			seg->quarters[ s ] = shadow[ s ];
+	seg->updated = (int64_t) time(0) * 1000;
+	seg->newest_stamp = newest;
+	seg->plots = plots;
+	seg->plots_missing = missing;
+	seg->alerts_firing = firing;
+	__atomic_store_n( &seg->generation, gen + 2, __ATOMIC_RELEASE );
+}
+
+
+void publish_exit( void )
+{
+	if ( !seg )
+		return;
+	munmap( seg, sizeof(publish_segment_t) );
+	seg = 0;
+	shm_unlink( segname );
+}
+
@@ -0,0 +1,65 @@
+// publish.h
+//
+// by Abraham Stolk.
+
+// Publishes the per-quarter harvest stats in a POSIX shared memory segment, so that other local tools can read them.
+//
+// The segment (default name /chiaharvestgraph) is a publish_segment_t, in host byte order, with natural alignment.
+// It is guarded by a sequence lock: the writer makes the generation odd before it changes anything, and even again
+// when it is done. A reader maps the segment read-only, and for a consistent snapshot it:
+//	1. loads the generation (with acquire semantics), and starts over if it is odd,
+//	2. reads whatever fields it needs, straight from the mapping,
+//	3. issues an acquire fence, loads the generation again, and starts over if it changed.
+// The writer never blocks on readers, and a reader does no syscalls after the mapping is made.
+// See shmreader.c for an example.
+//
+// Readers should check magic, version and the sizes, before they trust the layout.
+
+#define PUBLISH_MAGIC		0x53474843u	// "CHGS" in little-endian.
+#define PUBLISH_VERSION		2
+#define PUBLISH_NAME		"/chiaharvestgraph"
+#define PUBLISH_QUARTERS	( 4 * 24 * 7 )	// Same as MAXHIST: a week's worth of quarter-hours.
+
+typedef struct publish_quarter
+{
+	int64_t		timelo;		// Start of the quarter-hour, in seconds since the epoch.
+	int32_t		checks;		// Nr of challenges that the harvester(s) checked.
+	int32_t		eligible;	// Nr of plots that passed the filter.
+	int32_t		proofs;		// Nr of proofs found.
+	int32_t		poolpr;		// Nr of those that were submitted as pool partials.
+	float		avg_lookup;	// Average lookup time of checks with eligible plots, in seconds. 0 if none.
+	float		max_lookup;	// Slowest lookup time of checks with eligible plots, in seconds.
+	int32_t		eff_observed;	// Eligible plots of the checks that reported a plot count.
+	float		eff_expected;	// Eligible plots expected from those plot counts: plots / PLOT_FILTER.
+	float		eff_variance;	// Variance of eff_observed, if every plot is searched. See farmeff.h.
+	int32_t		reserved;
+} publish_quarter_t;			// 48 bytes. Version 1 had 32, without the eff_ fields.
+
+typedef struct publish_segment
+{
+	uint32_t	magic;		// PUBLISH_MAGIC
+	uint32_t	version;	// PUBLISH_VERSION
+	uint32_t	segment_size;	// sizeof(publish_segment_t)
+	uint32_t	quarter_size;	// sizeof(publish_quarter_t)
+	uint32_t	num_quarters;	// PUBLISH_QUARTERS
+	int32_t		pid;		// Process id of the writer.
+	uint64_t	generation;	// Seqlock: odd while the writer is busy.
+	int64_t		updated;	// When this was last published, in milliseconds since the epoch.
+	int64_t		newest_stamp;	// Stamp of the latest entry, in milliseconds since the epoch.
+	int32_t		plots;		// Current plot count.
+	int32_t		plots_missing;	// How many plots went missing since the count was highest.
+	int32_t		alerts_firing;	// Nr of alert rules that are firing.
+	int32_t		reserved;
+	publish_quarter_t quarters[ PUBLISH_QUARTERS ];	// Oldest first, the last one is the current quarter.
+} publish_segment_t;
+
+
+struct harvestgraph;
+
+extern int  publish_init( const char* name );
+
+// Publishes what changed in the history of hg.
+extern void publish_update( const struct harvestgraph* hg, int firing );
+
+extern void publish_exit( void );
+
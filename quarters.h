@@ -0,0 +1,29 @@
+// quarters.h
+//
+// by Abraham Stolk.
+
+// The harvest history: one slot per quarter-hour, holding the entries of that quarter in time order.
+
+#include "farmeff.h"
+
+#define	MAXHIST			( 4 * 24 * 7 )	// A week's worth of quarter-hours.
+#define MAXENTR			( 24 * 15 )	// We expect 6 per minute, worst-case: 12 per min, twice that when several come in the same second.
+
+typedef int64_t stamp_t;			// Milliseconds since the epoch.
+
+typedef struct quarterhr
+{
+	stamp_t	stamps[ MAXENTR ];
+	int	eligib[ MAXENTR ];
+	int	proofs[ MAXENTR ];
+	int	poolpr[ MAXENTR ];
+	float	durati[ MAXENTR ];
+	int	plots[ MAXENTR ];		// Plot count of the harvester that did the check.
+	farmeff_t eff;				// Observed vs expected eligible plots, over the entries.
+	int	sz;
+	time_t	timelo;
+	time_t	timehi;
+} quarterhr_t;
+
+
+
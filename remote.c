@@ -0,0 +1,655 @@
+// remote.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "remote.h"
+
+
+#define FRAMEHDRSZ		5
+#define MAXFRAMESZ		( 1 << 16 )
+#define MAXCONN			64
+#define MAXINFLIGHT		( 16 * REMOTE_MAXBATCH )	// Records that an agent sends ahead of the acks.
+#define MINBATCH		64				// Records that are worth a batch, without waiting.
+#define RECONNECT_INTERVAL	5				// Seconds between connection attempts.
+#define IO_TIMEOUT_MS		5000
+
+
+static uint8_t* put_varint( uint8_t* p, uint64_t v )
+{
+	while ( v >= 0x80 )
+	{
+		*p++ = (uint8_t) ( v | 0x80 );
+		v >>= 7;
+	}
+	*p++ = (uint8_t) v;
+	return p;
+}
+
+
+static const uint8_t* get_varint( const uint8_t* p, const uint8_t* end, uint64_t* v )
+{
+	uint64_t r = 0;
+	for ( int shift=0; p < end && shift < 64; shift += 7 )
+	{
+		const uint8_t b = *p++;
+		r |= (uint64_t) ( b & 0x7f ) << shift;
+		if ( !( b & 0x80 ) )
+		{
+			*v = r;
+			return p;
+		}
+	}
+	return 0;	// Truncated, or garbage.
+}
+
+
+static uint64_t zigzag( int64_t v )
+{
+	return ( (uint64_t) v << 1 ) ^ (uint64_t) ( v >> 63 );
+}
+
+
+static int64_t unzigzag( uint64_t v )
+{
+	return (int64_t) ( v >> 1 ) ^ -(int64_t) ( v & 1 );
+}
+
+
+static void put_frame_header( uint8_t* p, uint8_t type, uint32_t len )
+{
+	p[0] = type;
+	p[1] = (uint8_t) ( len >>  0 );
+	p[2] = (uint8_t) ( len >>  8 );
+	p[3] = (uint8_t) ( len >> 16 );
+	p[4] = (uint8_t) ( len >> 24 );
+}
+
+
+static uint32_t get_frame_length( const uint8_t* p )
+{
+	return (uint32_t) p[1] | (uint32_t) p[2] << 8 | (uint32_t) p[3] << 16 | (uint32_t) p[4] << 24;
+}
+
+
+static void set_nonblocking( int fd )
+{
+	const int flags = fcntl( fd, F_GETFL, 0 );
+	fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+}
+
+
+// An address with a slash in it is a Unix socket. Otherwise it is [host:]port.
+static int open_socket( const char* addr, int listening )
+{
+	if ( strchr( addr, '/' ) )
+	{
+		struct sockaddr_un sa;
+		memset( &sa, 0, sizeof(sa) );
+		sa.sun_family = AF_UNIX;
+		strncpy( sa.sun_path, addr, sizeof(sa.sun_path)-1 );
+		const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if ( fd < 0 )
+			return -1;
+		set_nonblocking( fd );
+		if ( listening )
+		{
+			unlink( addr );
+			if ( bind( fd, (struct sockaddr*) &sa, sizeof(sa) ) || listen( fd, 16 ) )
+			{
+				close( fd );
+				return -1;
+			}
+		}
+		else if ( connect( fd, (struct sockaddr*) &sa, sizeof(sa) ) && errno != EINPROGRESS )
+		{
+			close( fd );
+			return -1;
+		}
+		return fd;
+	}
+
+	char host[ 256 ];
+	const char* port = addr;
+	const char* colon = strrchr( addr, ':' );
+	host[0] = 0;
+	if ( colon )
+	{
+		const size_t len = colon - addr < (long) sizeof(host) - 1 ? colon - addr : sizeof(host) - 1;
+		memcpy( host, addr, len );
+		host[ len ] = 0;
+		port = colon + 1;
+	}
+
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	struct addrinfo* res = 0;
+	if ( getaddrinfo( host[0] ? host : 0, port, &hints, &res ) )
+		return -1;
+
+	int fd = -1;
+	for ( struct addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next )
+	{
+		fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+		if ( fd < 0 )
+			continue;
+		set_nonblocking( fd );
+		if ( listening )
+		{
+			const int one = 1;
+			setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+			if ( bind( fd, ai->ai_addr, ai->ai_addrlen ) || listen( fd, 16 ) )
+			{
+				close( fd );
+				fd = -1;
+			}
+		}
+		else if ( connect( fd, ai->ai_addr, ai->ai_addrlen ) && errno != EINPROGRESS )
+		{
+			close( fd );
+			fd = -1;
+		}
+	}
+	freeaddrinfo( res );
+	return fd;
+}
+
+
+static int wait_for( int fd, short events, int timeout_ms )
+{
+	struct pollfd pfd = { fd, events, 0 };
+	return poll( &pfd, 1, timeout_ms );
+}
+
+
+static int send_all( int fd, const uint8_t* buf, size_t len )
+{
+	while ( len )
+	{
+		const ssize_t n = send( fd, buf, len, MSG_NOSIGNAL );
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			if ( ( errno != EAGAIN && errno != EWOULDBLOCK ) || wait_for( fd, POLLOUT, IO_TIMEOUT_MS ) <= 0 )
+				return -1;
+			continue;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+
+//
+// Agent side.
+//
+
+static record_t ring[ AGENT_RING ];	// The latest records, indexed by sequence number.
+static uint64_t newest_seq = 0;		// Sequence number of latest record. The first record is 1.
+static uint64_t sent_seq = 0;		// Sent up to and including this one.
+static uint64_t acked_seq = 0;		// The viewer has everything up to and including this one.
+
+static int agent_fd = -1;
+static int agent_ready = 0;		// Did the viewer tell us where to resume?
+static const char* agent_addr = 0;
+static char agent_name[ 64 ];
+static uint64_t agent_epoch = 0;	// Tells the viewer that we restarted, and our sequence numbers start over.
+static time_t last_attempt = 0;
+static time_t last_send = 0;
+
+static uint8_t agent_inbuf[ 256 ];
+static size_t agent_inlen = 0;
+
+static uint64_t bytes_sent = 0;
+static uint64_t records_sent = 0;
+
+
+static void agent_disconnect( const char* why )
+{
+	if ( agent_fd >= 0 )
+	{
+		fprintf( stderr, "Disconnected from viewer %s: %s\n", agent_addr, why );
+		close( agent_fd );
+	}
+	agent_fd = -1;
+	agent_ready = 0;
+	agent_inlen = 0;
+	sent_seq = acked_seq;	// What was not acked, gets sent again.
+}
+
+
+static void agent_connect( void )
+{
+	agent_fd = open_socket( agent_addr, 0 );
+	if ( agent_fd < 0 )
+		return;
+	int soerr = 0;
+	socklen_t len = sizeof(soerr);
+	if ( wait_for( agent_fd, POLLOUT, 2000 ) <= 0 || getsockopt( agent_fd, SOL_SOCKET, SO_ERROR, &soerr, &len ) || soerr )
+	{
+		close( agent_fd );
+		agent_fd = -1;
+		return;
+	}
+
+	uint8_t frame[ FRAMEHDRSZ + 4 + 10 + sizeof(agent_name) ];
+	uint8_t* p = frame + FRAMEHDRSZ;
+	memcpy( p, "CHG1", 4 );
+	p = put_varint( p + 4, agent_epoch );
+	const size_t namelen = strlen( agent_name );
+	memcpy( p, agent_name, namelen );
+	p += namelen;
+	put_frame_header( frame, 'H', (uint32_t) ( p - frame - FRAMEHDRSZ ) );
+	if ( send_all( agent_fd, frame, p - frame ) )
+	{
+		agent_disconnect( "failed to send hello" );
+		return;
+	}
+	fprintf( stderr, "Connected to viewer %s\n", agent_addr );
+}
+
+
+static void agent_receive( void )
+{
+	while ( agent_fd >= 0 )
+	{
+		const ssize_t n = recv( agent_fd, agent_inbuf + agent_inlen, sizeof(agent_inbuf) - agent_inlen, MSG_DONTWAIT );
+		if ( n == 0 || ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+		{
+			agent_disconnect( n ? strerror( errno ) : "connection closed" );
+			return;
+		}
+		if ( n < 0 )
+			return;
+		agent_inlen += n;
+		while ( agent_inlen >= FRAMEHDRSZ )
+		{
+			const uint32_t len = get_frame_length( agent_inbuf );
+			if ( agent_inbuf[0] != 'A' || len > sizeof(agent_inbuf) - FRAMEHDRSZ )
+			{
+				agent_disconnect( "protocol error" );
+				return;
+			}
+			if ( agent_inlen < FRAMEHDRSZ + len )
+				break;
+			uint64_t seq = 0;
+			if ( get_varint( agent_inbuf + FRAMEHDRSZ, agent_inbuf + FRAMEHDRSZ + len, &seq ) )
+			{
+				acked_seq = seq > newest_seq ? newest_seq : seq;
+				if ( !agent_ready )
+				{
+					// Backfill from where the viewer left off, as far as we still have it.
+					const uint64_t oldest = newest_seq >= AGENT_RING ? newest_seq - AGENT_RING + 1 : 1;
+					acked_seq = acked_seq + 1 < oldest ? oldest - 1 : acked_seq;
+					sent_seq = acked_seq;
+					agent_ready = 1;
+					fprintf( stderr, "Viewer has %llu records, we have %llu.\n", (unsigned long long) seq, (unsigned long long) newest_seq );
+				}
+			}
+			memmove( agent_inbuf, agent_inbuf + FRAMEHDRSZ + len, agent_inlen - FRAMEHDRSZ - len );
+			agent_inlen -= FRAMEHDRSZ + len;
+		}
+	}
+}
+
+
+static int agent_send_batch( void )
+{
+	static uint8_t frame[ FRAMEHDRSZ + 32 + REMOTE_MAXBATCH * 50 ];
+	const uint64_t first = sent_seq + 1;
+	const int count = newest_seq - sent_seq < REMOTE_MAXBATCH ? (int) ( newest_seq - sent_seq ) : REMOTE_MAXBATCH;
+	int64_t prev_t = ring[ first % AGENT_RING ].t;
+	int prev_plots = 0;
+
+	uint8_t* p = frame + FRAMEHDRSZ;
+	p = put_varint( p, count );
+	p = put_varint( p, first );
+	p = put_varint( p, (uint64_t) prev_t );
+	for ( int k=0; k<count; ++k )
+	{
+		const record_t* r = ring + ( first + k ) % AGENT_RING;
+		const uint32_t dur = r->durat > 0 ? (uint32_t) ( r->durat * 10000 + 0.5f ) : 0;
+		p = put_varint( p, zigzag( r->t - prev_t ) );
+		p = put_varint( p, r->eligi < 0 ? 0 : r->eligi );
+		p = put_varint( p, r->proof < 0 ? 0 : r->proof );
+		p = put_varint( p, dur );
+		p = put_varint( p, zigzag( r->plots - prev_plots ) );
+		prev_t = r->t;
+		prev_plots = r->plots;
+	}
+	const size_t sz = p - frame;
+	put_frame_header( frame, 'B', (uint32_t) ( sz - FRAMEHDRSZ ) );
+	if ( send_all( agent_fd, frame, sz ) )
+	{
+		agent_disconnect( "failed to send" );
+		return -1;
+	}
+	sent_seq += count;
+	bytes_sent += sz;
+	records_sent += count;
+	return count;
+}
+
+
+int agent_init( const char* addr, const char* name )
+{
+	agent_addr = addr;
+	strncpy( agent_name, name, sizeof(agent_name)-1 );
+	agent_epoch = (uint64_t) time(0) << 20 ^ (uint64_t) getpid();
+	return 0;
+}
+
+
+void agent_record( const record_t* r )
+{
+	newest_seq += 1;
+	ring[ newest_seq % AGENT_RING ] = *r;
+}
+
+
+void agent_update( void )
+{
+	const time_t now = time(0);
+	if ( agent_fd < 0 )
+	{
+		if ( now - last_attempt < RECONNECT_INTERVAL )
+			return;
+		last_attempt = now;
+		agent_connect();
+		if ( agent_fd < 0 )
+			return;
+		wait_for( agent_fd, POLLIN, IO_TIMEOUT_MS );
+	}
+
+	agent_receive();
+
+	// Batch up: send when a batch is worth it, or when the oldest unsent record has waited a second.
+	// A backlog, like the history that we read at start-up, is always worth a batch, so it goes out right away.
+	if ( agent_fd < 0 || !agent_ready || sent_seq == newest_seq )
+		return;
+	if ( newest_seq - sent_seq < MINBATCH && now == last_send )
+		return;
+
+	const uint64_t before = records_sent;
+	while ( agent_fd >= 0 && sent_seq < newest_seq )
+	{
+		if ( sent_seq - acked_seq >= MAXINFLIGHT )
+		{
+			// Wait for the viewer to catch up.
+			if ( wait_for( agent_fd, POLLIN, IO_TIMEOUT_MS ) <= 0 )
+			{
+				agent_disconnect( "viewer does not ack" );
+				return;
+			}
+			agent_receive();
+			continue;
+		}
+		if ( agent_send_batch() < 0 )
+			return;
+	}
+	last_send = now;
+	if ( records_sent - before > REMOTE_MAXBATCH )
+		fprintf
+		(
+			stderr,
+			"Sent %llu records, at %.1f bytes per record.\n",
+			(unsigned long long) ( records_sent - before ),
+			(double) bytes_sent / records_sent
+		);
+}
+
+
+//
+// Viewer side.
+//
+
+typedef struct conn
+{
+	int		fd;
+	int		agentnr;	// -1 until we got a hello.
+	size_t		inlen;
+	uint8_t*	inbuf;
+} conn_t;
+
+typedef struct agentinfo
+{
+	char		name[ 64 ];
+	uint64_t	epoch;
+	uint64_t	last_seq;	// Last sequence number we got from this agent.
+	int64_t		last_t;		// Stamp of the last record we got from it.
+	int64_t		resume_t;	// After an agent restarts, it sends its history again. Skip what we had.
+	int		connected;
+} agentinfo_t;
+
+static int listen_fd = -1;
+static conn_t conns[ MAXCONN ];
+static int numconns = 0;
+static agentinfo_t agents[ REMOTE_MAXAGENTS ];
+static int numagents = 0;
+
+
+static void close_conn( int c )
+{
+	if ( conns[c].agentnr >= 0 )
+		agents[ conns[c].agentnr ].connected = 0;
+	close( conns[c].fd );
+	free( conns[c].inbuf );
+	conns[c] = conns[ --numconns ];
+}
+
+
+static void send_ack( int fd, uint64_t seq )
+{
+	uint8_t frame[ FRAMEHDRSZ + 10 ];
+	uint8_t* p = put_varint( frame + FRAMEHDRSZ, seq );
+	put_frame_header( frame, 'A', (uint32_t) ( p - frame - FRAMEHDRSZ ) );
+	send_all( fd, frame, p - frame );
+}
+
+
+static int handle_hello( conn_t* c, const uint8_t* p, const uint8_t* end )
+{
+	uint64_t epoch = 0;
+	if ( end - p < 4 || memcmp( p, "CHG1", 4 ) || !( p = get_varint( p+4, end, &epoch ) ) )
+		return -1;
+	char name[ 64 ];
+	const size_t len = end - p < (long) sizeof(name) - 1 ? (size_t) ( end - p ) : sizeof(name) - 1;
+	memcpy( name, p, len );
+	name[ len ] = 0;
+
+	int nr = 0;
+	while ( nr < numagents && strcmp( agents[nr].name, name ) )
+		nr++;
+	if ( nr == numagents )
+	{
+		if ( numagents == REMOTE_MAXAGENTS )
+			return -1;
+		memset( agents + nr, 0, sizeof(agentinfo_t) );
+		strcpy( agents[nr].name, name );
+		agents[nr].epoch = epoch;
+		numagents++;
+	}
+	agentinfo_t* a = agents + nr;
+	if ( a->epoch != epoch )
+	{
+		// The agent restarted: its sequence numbers start over, and it will send its history again.
+		a->epoch = epoch;
+		a->last_seq = 0;
+		a->resume_t = a->last_t;
+	}
+	a->connected = 1;
+	c->agentnr = nr;
+	fprintf( stderr, "Agent %s connected, resuming after record %llu.\n", name, (unsigned long long) a->last_seq );
+	send_ack( c->fd, a->last_seq );
+	return 0;
+}
+
+
+static int handle_batch( conn_t* c, const uint8_t* p, const uint8_t* end, record_cb_t cb )
+{
+	if ( c->agentnr < 0 )
+		return -1;
+	agentinfo_t* a = agents + c->agentnr;
+	uint64_t count, first, base;
+	if ( !( p = get_varint( p, end, &count ) ) || !( p = get_varint( p, end, &first ) ) || !( p = get_varint( p, end, &base ) ) )
+		return -1;
+	int64_t prev_t = (int64_t) base;
+	int prev_plots = 0;
+	for ( uint64_t k=0; k<count; ++k )
+	{
+		uint64_t dt, eligi, proof, dur, dplots;
+		if
+		(
+			!( p = get_varint( p, end, &dt     ) ) ||
+			!( p = get_varint( p, end, &eligi  ) ) ||
+			!( p = get_varint( p, end, &proof  ) ) ||
+			!( p = get_varint( p, end, &dur    ) ) ||
+			!( p = get_varint( p, end, &dplots ) )
+		)
+			return -1;
+		record_t r;
+		r.t = prev_t + unzigzag( dt );
+		r.eligi = (int) eligi;
+		r.proof = (int) proof;
+		r.durat = dur / 10000.0f;
+		r.plots = prev_plots + (int) unzigzag( dplots );
+		prev_t = r.t;
+		prev_plots = r.plots;
+
+		const uint64_t seq = first + k;
+		if ( seq <= a->last_seq )
+			continue;	// We had this one already, it was sent again after a reconnect.
+		a->last_seq = seq;
+		if ( r.t <= a->resume_t )
+			continue;	// We had this one already, from before the agent restarted.
+		a->last_t = r.t;
+		cb( &r, c->agentnr );
+	}
+	send_ack( c->fd, a->last_seq );
+	return 0;
+}
+
+
+static int handle_input( conn_t* c, record_cb_t cb )
+{
+	while ( 1 )
+	{
+		const ssize_t n = recv( c->fd, c->inbuf + c->inlen, MAXFRAMESZ - c->inlen, MSG_DONTWAIT );
+		if ( n == 0 )
+			return -1;
+		if ( n < 0 )
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) ? 0 : -1;
+		c->inlen += n;
+		size_t off = 0;
+		while ( c->inlen - off >= FRAMEHDRSZ )
+		{
+			const uint8_t* f = c->inbuf + off;
+			const uint32_t len = get_frame_length( f );
+			if ( len > MAXFRAMESZ - FRAMEHDRSZ )
+				return -1;
+			if ( c->inlen - off < FRAMEHDRSZ + len )
+				break;
+			const uint8_t* p = f + FRAMEHDRSZ;
+			int rv = -1;
+			if ( f[0] == 'H' )
+				rv = handle_hello( c, p, p + len );
+			if ( f[0] == 'B' )
+				rv = handle_batch( c, p, p + len, cb );
+			if ( rv )
+				return -1;
+			off += FRAMEHDRSZ + len;
+		}
+		memmove( c->inbuf, c->inbuf + off, c->inlen - off );
+		c->inlen -= off;
+	}
+}
+
+
+int viewer_init( const char* addr )
+{
+	listen_fd = open_socket( addr, 1 );
+	if ( listen_fd < 0 )
+	{
+		perror( "Failed to listen for agents" );
+		return -1;
+	}
+	return 0;
+}
+
+
+// Waits at most timeout_ms for agents to send something, and passes the new records to cb.
+int viewer_update( int timeout_ms, record_cb_t cb )
+{
+	struct pollfd pfds[ MAXCONN + 1 ];
+	pfds[0].fd = listen_fd;
+	pfds[0].events = POLLIN;
+	for ( int c=0; c<numconns; ++c )
+	{
+		pfds[c+1].fd = conns[c].fd;
+		pfds[c+1].events = POLLIN;
+	}
+	const int nfds = numconns + 1;
+	const int ready = poll( pfds, nfds, timeout_ms );
+	if ( ready <= 0 )
+		return 0;
+
+	// Walk backwards, as closing a connection moves the last one in its place.
+	for ( int c=nfds-2; c>=0; --c )
+		if ( pfds[c+1].revents && handle_input( conns + c, cb ) )
+		{
+			if ( conns[c].agentnr >= 0 )
+				fprintf( stderr, "Agent %s disconnected.\n", agents[ conns[c].agentnr ].name );
+			close_conn( c );
+		}
+
+	if ( pfds[0].revents & POLLIN )
+	{
+		const int fd = accept( listen_fd, 0, 0 );
+		if ( fd >= 0 && numconns < MAXCONN )
+		{
+			set_nonblocking( fd );
+			conns[ numconns ].fd = fd;
+			conns[ numconns ].agentnr = -1;
+			conns[ numconns ].inlen = 0;
+			conns[ numconns ].inbuf = (uint8_t*) malloc( MAXFRAMESZ );
+			numconns++;
+		}
+		else if ( fd >= 0 )
+			close( fd );
+	}
+	return ready;
+}
+
+
+int viewer_num_agents( void )
+{
+	return numagents;
+}
+
+
+int viewer_num_connected( void )
+{
+	int n = 0;
+	for ( int a=0; a<numagents; ++a )
+		n += agents[a].connected;
+	return n;
+}
+
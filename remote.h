@@ -0,0 +1,44 @@
+// remote.h
+//
+// by Abraham Stolk.
+
+// Ships harvester entries from agents (one per harvester) to a central viewer, over TCP or a Unix socket.
+//
+// Every message is a frame: a type byte, a little-endian uint32 payload length, and the payload.
+//	'H'	agent->viewer	Hello: "CHG1", varint epoch (new for every agent run) and then the name of the agent.
+//	'A'	viewer->agent	Ack: varint of the last sequence number that the viewer has from this agent.
+//	'B'	agent->viewer	Batch: varint count, varint seq of first record, varint stamp (ms) and then the records.
+// A record is: zigzag varint stamp delta (ms), varint eligible, varint proofs, varint duration (0.1ms), zigzag varint plot count delta.
+// A typical record takes 7 or 8 bytes, compared to some 200 bytes for the log line it came from.
+
+#define AGENT_RING		65536	// Records that an agent keeps for backfill: a week worth of checks.
+#define REMOTE_MAXBATCH		256	// Max records per batch.
+#define REMOTE_MAXAGENTS	64	// Max agents that a viewer keeps track of.
+
+typedef struct record
+{
+	int64_t	t;		// In ms.
+	int	eligi;
+	int	proof;
+	float	durat;
+	int	plots;
+} record_t;
+
+typedef void (*record_cb_t)( const record_t* r, int agentnr );
+
+
+extern int  agent_init( const char* addr, const char* name );
+
+extern void agent_record( const record_t* r );
+
+extern void agent_update( void );
+
+
+extern int  viewer_init( const char* addr );
+
+extern int  viewer_update( int timeout_ms, record_cb_t cb );
+
+extern int  viewer_num_agents( void );
+
+extern int  viewer_num_connected( void );
+
@@ -0,0 +1,97 @@
+// reorder.c
+//
+// by Abraham Stolk.
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "quarters.h"
+#include "reorder.h"
+
+
+static int before( const entry_t* a, const entry_t* b )
+{
+	return a->t < b->t || ( a->t == b->t && a->hash < b->hash );
+}
+
+
+static void swap( entry_t* a, entry_t* b )
+{
+	const entry_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+
+static void remove_top( reorder_t* r )
+{
+	r->heap[ 0 ] = r->heap[ --r->sz ];
+	int i = 0;
+	while ( 1 )
+	{
+		const int l = 2*i+1;
+		const int h = 2*i+2;
+		int m = i;
+		if ( l < r->sz && before( r->heap+l, r->heap+m ) ) m = l;
+		if ( h < r->sz && before( r->heap+h, r->heap+m ) ) m = h;
+		if ( m == i )
+			break;
+		swap( r->heap+i, r->heap+m );
+		i = m;
+	}
+}
+
+
+void reorder_init( reorder_t* r )
+{
+	memset( r, 0, sizeof(reorder_t) );
+}
+
+
+// Returns 0 if the entry was dropped, because it is older than what already left the buffer.
+// When the buffer is full, the oldest entry must be popped first.
+int reorder_push( reorder_t* r, const entry_t* e )
+{
+	const entry_t last = { r->last_t, r->last_hash };
+	if ( !before( &last, e ) )
+	{
+		if ( e->t == last.t && e->hash == last.hash )
+			r->duplicates += 1;
+		else
+			r->late += 1;
+		return 0;
+	}
+	if ( r->sz == REORDER_CAP )
+		return -1;
+	int i = r->sz++;
+	r->heap[ i ] = *e;
+	while ( i > 0 && before( r->heap+i, r->heap+(i-1)/2 ) )
+	{
+		swap( r->heap+i, r->heap+(i-1)/2 );
+		i = (i-1)/2;
+	}
+	return 1;
+}
+
+
+// Pops the oldest entry if it is at or before upto, or if the buffer is full.
+// Duplicates sort next to each other, so they are dropped here, in O(1).
+int reorder_pop( reorder_t* r, stamp_t upto, entry_t* e )
+{
+	while ( r->sz && ( r->heap[ 0 ].t <= upto || r->sz == REORDER_CAP ) )
+	{
+		*e = r->heap[ 0 ];
+		remove_top( r );
+		if ( e->t == r->last_t && e->hash == r->last_hash )
+		{
+			r->duplicates += 1;
+			continue;
+		}
+		r->last_t = e->t;
+		r->last_hash = e->hash;
+		return 1;
+	}
+	return 0;
+}
+
@@ -0,0 +1,37 @@
+// reorder.h
+//
+// by Abraham Stolk.
+
+// A small bounded buffer that puts harvester entries back in time order, before they go into the history.
+// Entries are keyed by (timestamp, challenge hash), so that a replayed line is never counted twice.
+
+#define REORDER_CAP		64	// Max nr of entries held back.
+#define REORDER_SLACK_MS	2000	// How far out of order an entry may arrive.
+
+typedef struct entry
+{
+	stamp_t		t;		// Milliseconds since the epoch.
+	uint64_t	hash;		// Leading bits of the challenge hash.
+	int		eligi;
+	int		proof;
+	int		plots;
+	float		durat;
+} entry_t;
+
+typedef struct reorder
+{
+	entry_t		heap[ REORDER_CAP ];	// Min-heap on (t, hash).
+	int		sz;
+	stamp_t		last_t;			// Key of the last entry that left the buffer.
+	uint64_t	last_hash;
+	int		duplicates;		// Nr of entries dropped, because we had them already.
+	int		late;			// Nr of entries dropped, because they came too late.
+} reorder_t;
+
+
+extern void reorder_init( reorder_t* r );
+
+extern int  reorder_push( reorder_t* r, const entry_t* e );
+
+extern int  reorder_pop( reorder_t* r, stamp_t upto, entry_t* e );
+
@@ -0,0 +1,330 @@
+// rollup.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "plotseries.h"
+#include "rollup.h"
+
+
+void rollup_init( rollup_t* ru )
+{
+	memset( ru, 0, sizeof(rollup_t) );
+	plotseries_init( &ru->plots );
+}
+
+
+void rollup_free( rollup_t* ru )
+{
+	free( ru->plots.runs );
+	ru->plots.runs = 0;
+}
+
+
+// The day that t falls in, or 0 if its slot is taken by a newer day.
+static dayroll_t* day_of( rollup_t* ru, time_t t )
+{
+	if ( t < ru->daylo || t >= ru->dayhi )
+	{
+		struct tm tim;
+		localtime_r( &t, &tim );
+		tim.tm_sec = 0;
+		tim.tm_min = 0;
+		tim.tm_hour = 0;
+		tim.tm_isdst = -1;
+		ru->daylo = mktime( &tim );
+		tim.tm_mday += 1;
+		tim.tm_hour = 0;
+		tim.tm_isdst = -1;
+		ru->dayhi = mktime( &tim );
+	}
+	const time_t nr = ( ru->daylo + 43200 ) / 86400;	// Days since the epoch, whatever the time zone.
+	dayroll_t* d = ru->days + nr % ROLLUP_DAYS;
+	if ( d->start > ru->daylo )
+		return 0;
+	if ( d->start < ru->daylo )
+	{
+		memset( d, 0, sizeof(dayroll_t) );
+		d->start = ru->daylo;
+		d->end = ru->dayhi;
+		d->plots_first = -1;
+		d->plots_last = -1;
+		d->plots_min = -1;
+		d->plots_max = -1;
+	}
+	return d;
+}
+
+
+static int lookup_bin( float ms )
+{
+	const int b = (int) ( 4.0f * log2f( 1.0f + ( ms > 0 ? ms : 0 ) ) );
+	return b < ROLLUP_BINS ? b : ROLLUP_BINS-1;
+}
+
+
+static void plotchange( rollup_t* ru, time_t t, int kind )
+{
+	dayroll_t* d = day_of( ru, t );
+	if ( !d )
+		return;
+	d->plot_changes += 1;
+	d->plot_drops += kind < 0;
+}
+
+
+// Confirms changes of the plot count the same way as the graph does, but for as far back as the days go.
+static void track_plots( rollup_t* ru, time_t t, int plots )
+{
+	plotseries_t* ps = &ru->plots;
+	const int runs = ps->sz;
+	plotseries_add( ps, t, plots );
+	if ( ps->sz == runs || !runs )
+		return;
+	const plotrun_t run = ps->runs[ ps->sz - 1 ];
+	plotchange( ru, run.start, run.kind );
+	plotseries_trim( ps, run.start );	// Only the latest run matters to us.
+}
+
+
+void rollup_check( rollup_t* ru, int64_t stamp, int eligi, int proof, int poolpr, float durat, int plots )
+{
+	if ( stamp <= ru->held_check )
+		return;
+	ru->newest_check = stamp > ru->newest_check ? stamp : ru->newest_check;
+	const time_t t = (time_t) ( stamp / 1000 );
+	dayroll_t* d = day_of( ru, t );
+	if ( !d )
+		return;
+	d->checks += 1;
+	d->eligible += eligi;
+	d->proofs += proof;
+	d->partials += poolpr;
+	const int qi = (int) ( ( t - d->start ) / 900 );
+	if ( qi < ROLLUP_QUARTERS )
+		d->qchecks[ qi ] += d->qchecks[ qi ] < UINT16_MAX;
+	if ( eligi > 0 )
+	{
+		d->lookup[ lookup_bin( durat * 1000 ) ] += 1;
+		d->max_lookup = durat > d->max_lookup ? durat : d->max_lookup;
+	}
+	if ( plots > 0 )
+	{
+		d->plots_first = d->plots_first < 0 ? plots : d->plots_first;
+		d->plots_last = plots;
+		d->plots_min = d->plots_min < 0 || plots < d->plots_min ? plots : d->plots_min;
+		d->plots_max = plots > d->plots_max ? plots : d->plots_max;
+	}
+	ru->first = !ru->first || t < ru->first ? t : ru->first;
+	ru->last = t > ru->last ? t : ru->last;
+	if ( plots > 0 )
+		track_plots( ru, t, plots );
+}
+
+
+void rollup_partial( rollup_t* ru, int64_t stamp )
+{
+	if ( stamp <= ru->held_partial )
+		return;
+	ru->newest_partial = stamp > ru->newest_partial ? stamp : ru->newest_partial;
+	dayroll_t* d = day_of( ru, (time_t) ( stamp / 1000 ) );
+	if ( d )
+		d->partials += 1;
+}
+
+
+#define HEADERSIZE	64
+#define DAYSIZE		552
+
+static void put_le( uint8_t* dst, uint64_t v, int sz )
+{
+	for ( int i=0; i<sz; ++i )
+		dst[ i ] = (uint8_t) ( v >> ( 8*i ) );
+}
+
+
+static uint64_t get_le( const uint8_t* src, int sz )
+{
+	uint64_t v = 0;
+	for ( int i=0; i<sz; ++i )
+		v |= (uint64_t) src[ i ] << ( 8*i );
+	return v;
+}
+
+
+static void put_day( uint8_t* dst, const dayroll_t* d )
+{
+	const int counts[ 10 ] =
+	{
+		d->checks, d->eligible, d->proofs, d->partials, d->plots_first,
+		d->plots_last, d->plots_min, d->plots_max, d->plot_changes, d->plot_drops
+	};
+	uint32_t bits;
+	memcpy( &bits, &d->max_lookup, 4 );
+	memset( dst, 0, DAYSIZE );
+	put_le( dst + 0, (uint64_t) d->start, 8 );
+	put_le( dst + 8, (uint64_t) d->end, 8 );
+	for ( int i=0; i<10; ++i )
+		put_le( dst + 16 + 4*i, (uint32_t) counts[ i ], 4 );
+	put_le( dst + 56, bits, 4 );
+	for ( int qi=0; qi<ROLLUP_QUARTERS; ++qi )
+		put_le( dst + 64 + 2*qi, d->qchecks[ qi ], 2 );
+	for ( int b=0; b<ROLLUP_BINS; ++b )
+		put_le( dst + 264 + 4*b, d->lookup[ b ], 4 );
+}
+
+
+static void get_day( dayroll_t* d, const uint8_t* src )
+{
+	int* counts[ 10 ] =
+	{
+		&d->checks, &d->eligible, &d->proofs, &d->partials, &d->plots_first,
+		&d->plots_last, &d->plots_min, &d->plots_max, &d->plot_changes, &d->plot_drops
+	};
+	d->start = (time_t) (int64_t) get_le( src + 0, 8 );
+	d->end = (time_t) (int64_t) get_le( src + 8, 8 );
+	for ( int i=0; i<10; ++i )
+		*counts[ i ] = (int32_t) get_le( src + 16 + 4*i, 4 );
+	const uint32_t bits = (uint32_t) get_le( src + 56, 4 );
+	memcpy( &d->max_lookup, &bits, 4 );
+	for ( int qi=0; qi<ROLLUP_QUARTERS; ++qi )
+		d->qchecks[ qi ] = (uint16_t) get_le( src + 64 + 2*qi, 2 );
+	for ( int b=0; b<ROLLUP_BINS; ++b )
+		d->lookup[ b ] = (uint32_t) get_le( src + 264 + 4*b, 4 );
+}
+
+
+int rollup_save( const rollup_t* ru, FILE* f )
+{
+	const plotseries_t* ps = &ru->plots;
+	const plotrun_t* run = ps->sz ? ps->runs + ps->sz - 1 : 0;
+	int n = 0;
+	for ( int i=0; i<ROLLUP_DAYS; ++i )
+		n += ru->days[ i ].start != 0;
+	uint8_t hdr[ HEADERSIZE ];
+	memset( hdr, 0, sizeof(hdr) );
+	memcpy( hdr, "CHGDAY1", 8 );
+	put_le( hdr +  8, (uint32_t) n, 4 );
+	put_le( hdr + 12, DAYSIZE, 4 );
+	put_le( hdr + 16, (uint64_t) ru->first, 8 );
+	put_le( hdr + 24, (uint64_t) ru->last, 8 );
+	put_le( hdr + 32, (uint64_t) ru->newest_check, 8 );
+	put_le( hdr + 40, (uint64_t) ru->newest_partial, 8 );
+	put_le( hdr + 48, (uint32_t) ( run ? run->count : -1 ), 4 );
+	put_le( hdr + 52, (uint32_t) ( run ? run->kind : 0 ), 4 );
+	put_le( hdr + 56, (uint64_t) ( run ? run->start : 0 ), 8 );
+	fwrite( hdr, sizeof(hdr), 1, f );
+	for ( int i=0; i<ROLLUP_DAYS; ++i )
+		if ( ru->days[ i ].start )
+		{
+			uint8_t rec[ DAYSIZE ];
+			put_day( rec, ru->days + i );
+			fwrite( rec, sizeof(rec), 1, f );
+		}
+	return ferror( f ) ? -1 : 0;
+}
+
+
+int rollup_load( rollup_t* ru, FILE* f )
+{
+	uint8_t hdr[ HEADERSIZE ];
+	if ( fread( hdr, sizeof(hdr), 1, f ) != 1 || memcmp( hdr, "CHGDAY1", 8 ) || get_le( hdr + 12, 4 ) != DAYSIZE )
+		return -1;
+	const uint32_t n = (uint32_t) get_le( hdr + 8, 4 );
+	if ( n > ROLLUP_DAYS )
+		return -1;
+	for ( uint32_t k=0; k<n; ++k )
+	{
+		uint8_t rec[ DAYSIZE ];
+		dayroll_t d;
+		if ( fread( rec, sizeof(rec), 1, f ) != 1 )
+			return -1;
+		get_day( &d, rec );
+		const time_t nr = ( d.start + 43200 ) / 86400;	// The same slot as day_of() would pick.
+		if ( d.start > ru->days[ nr % ROLLUP_DAYS ].start )
+			ru->days[ nr % ROLLUP_DAYS ] = d;
+	}
+	ru->first = (time_t) (int64_t) get_le( hdr + 16, 8 );
+	ru->last = (time_t) (int64_t) get_le( hdr + 24, 8 );
+	ru->newest_check = (int64_t) get_le( hdr + 32, 8 );
+	ru->newest_partial = (int64_t) get_le( hdr + 40, 8 );
+	ru->held_check = ru->newest_check;
+	ru->held_partial = ru->newest_partial;
+	const int plots = (int32_t) get_le( hdr + 48, 4 );
+	if ( plots > 0 )
+	{
+		plotseries_add( &ru->plots, (time_t) (int64_t) get_le( hdr + 56, 8 ), plots );
+		ru->plots.runs[ 0 ].kind = (int32_t) get_le( hdr + 52, 4 );
+	}
+	return (int) n;
+}
+
+
+static int by_start( const void* a, const void* b )
+{
+	const dayroll_t* da = *(const dayroll_t* const*) a;
+	const dayroll_t* db = *(const dayroll_t* const*) b;
+	return ( da->start > db->start ) - ( da->start < db->start );
+}
+
+
+int rollup_days( const rollup_t* ru, const dayroll_t** days, int max )
+{
+	const dayroll_t* all[ ROLLUP_DAYS ];
+	int n = 0;
+	for ( int i=0; i<ROLLUP_DAYS; ++i )
+		if ( ru->days[ i ].start && ru->days[ i ].checks )
+			all[ n++ ] = ru->days + i;
+	qsort( all, n, sizeof(all[0]), by_start );
+	const int skip = n > max ? n - max : 0;
+	for ( int i=skip; i<n; ++i )
+		days[ i - skip ] = all[ i ];
+	return n - skip;
+}
+
+
+void rollup_uptime( const dayroll_t* d, time_t from, time_t to, int* up, int* total )
+{
+	*up = 0;
+	*total = 0;
+	const time_t lo = from > d->start ? from : d->start;
+	const time_t hi = to < d->end ? to : d->end;
+	for ( int qi=0; qi<ROLLUP_QUARTERS; ++qi )
+	{
+		const time_t q0 = d->start + 900 * qi;
+		if ( q0 + 900 > hi )
+			break;
+		if ( q0 < lo )
+			continue;
+		*total += 1;
+		*up += d->qchecks[ qi ] >= ROLLUP_NOMINAL;
+	}
+}
+
+
+int rollup_percentile( const uint32_t* hist, int pct )
+{
+	uint64_t n = 0;
+	for ( int b=0; b<ROLLUP_BINS; ++b )
+		n += hist[ b ];
+	if ( !n )
+		return -1;
+	const uint64_t rank = ( n * pct + 99 ) / 100;
+	uint64_t acc = 0;
+	int b = 0;
+	for ( b=0; b<ROLLUP_BINS-1; ++b )
+	{
+		acc += hist[ b ];
+		if ( acc >= rank )
+			break;
+	}
+	// The middle of the bin, on a log scale.
+	return (int) ( exp2f( ( b + 0.5f ) / 4.0f ) - 1.0f + 0.5f );
+}
+
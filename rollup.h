@@ -0,0 +1,86 @@
+// rollup.h
+//
+// by Abraham Stolk.
+
+// Daily rollups of the harvest: kept up to date as entries come in, so that a report over months is a sum over days,
+// and not a scan over entries. Days are local days, and unlike the quarters of the graph, go back more than a year.
+// Include plotseries.h first.
+//
+// The days can be saved to a file, so that they outlive the logs. It is little-endian:
+//
+//	offset	size	field
+//	0	8	magic "CHGDAY1\0"
+//	8	4	number of days
+//	12	4	size of a day (552)
+//	16	8	first, last: the oldest and newest check, in seconds since the epoch
+//	32	8	newest check, in ms
+//	40	8	newest partial, in ms
+//	48	4	confirmed plot count of the farm, -1 if not known
+//	52	4	kind of its run
+//	56	8	start of its run
+//	64	552*n	the days: start, end (int64), the ten counts from checks to plot_drops (int32), max_lookup (float32),
+//			4 bytes of padding, qchecks (uint16) and lookup (uint32)
+
+#define ROLLUP_DAYS		400	// Days that we keep.
+#define ROLLUP_QUARTERS		100	// Quarter-hours in a day: 25 hours on the day that summer time ends.
+#define ROLLUP_BINS		72	// Four bins per octave of milliseconds, up to two minutes.
+#define ROLLUP_NOMINAL		86	// Checks in a quarter-hour, to count it as up: nine in ten of its 96 signage points.
+
+typedef struct dayroll
+{
+	time_t		start;		// Local midnight. 0 if the slot is unused.
+	time_t		end;		// The next midnight.
+	int		checks;
+	int		eligible;
+	int		proofs;
+	int		partials;	// Pool partials that the farmer submitted.
+	int		plots_first;	// Plot count of the farm at the first check of the day, -1 if not known.
+	int		plots_last;
+	int		plots_min;
+	int		plots_max;
+	int		plot_changes;	// Confirmed changes of the plot count.
+	int		plot_drops;	// How many of those were drops.
+	float		max_lookup;	// Slowest lookup of a check with eligible plots, in seconds.
+	uint16_t	qchecks[ ROLLUP_QUARTERS ];	// Checks per quarter-hour of the day.
+	uint32_t	lookup[ ROLLUP_BINS ];		// Lookup times of checks with eligible plots.
+} dayroll_t;
+
+typedef struct rollup
+{
+	dayroll_t	days[ ROLLUP_DAYS ];
+	time_t		daylo;		// The day that the last entry went into, so that we only need the time zone once a day.
+	time_t		dayhi;
+	time_t		first;		// Time of the oldest check, 0 if none.
+	time_t		last;		// Time of the newest check.
+	plotseries_t	plots;		// The plot count of the farm, to see changes in days that the graph no longer has.
+	int64_t		newest_check;	// In ms.
+	int64_t		newest_partial;
+	int64_t		held_check;	// What the days that we loaded already hold: we skip these when they come in again.
+	int64_t		held_partial;
+} rollup_t;
+
+
+extern void rollup_init( rollup_t* ru );
+
+extern void rollup_free( rollup_t* ru );
+
+// Stamps are in ms.
+extern void rollup_check( rollup_t* ru, int64_t stamp, int eligi, int proof, int poolpr, float durat, int plots );
+
+extern void rollup_partial( rollup_t* ru, int64_t stamp );
+
+// Returns -1 if the days could not be written.
+extern int  rollup_save( const rollup_t* ru, FILE* f );
+
+// Reads the days that rollup_save() wrote, into a rollup that has no days yet. Returns how many, or -1 if it is not a file of days.
+extern int  rollup_load( rollup_t* ru, FILE* f );
+
+// Fills days with the newest max days that have checks, oldest first. Returns how many.
+extern int  rollup_days( const rollup_t* ru, const dayroll_t** days, int max );
+
+// Nr of quarter-hours of the day that fall in [from,to) and how many of those were up.
+extern void rollup_uptime( const dayroll_t* d, time_t from, time_t to, int* up, int* total );
+
+// The pct-th percentile of the lookup times in the histogram, in ms. -1 if it is empty.
+extern int  rollup_percentile( const uint32_t* hist, int pct );
+
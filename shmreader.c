@@ -0,0 +1,119 @@
+// shmreader.c
+//
+// by Abraham Stolk.
+//
+// Example of a tool that reads the harvest stats that chiaharvestgraph publishes in shared memory.
+// Usage: shmreader [numquarters [segmentname]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "publish.h"
+
+
+typedef struct snapshot
+{
+	int64_t		newest_stamp;
+	int32_t		plots;
+	int32_t		plots_missing;
+	int32_t		alerts_firing;
+	int32_t		pid;
+	publish_quarter_t quarters[ PUBLISH_QUARTERS ];
+} snapshot_t;
+
+
+// Copies what we need out of the segment, retrying if the writer was busy with it.
+static int take_snapshot( const publish_segment_t* seg, snapshot_t* snap, int numq )
+{
+	for ( int attempt=0; attempt<1000; ++attempt )
+	{
+		const uint64_t g0 = __atomic_load_n( &seg->generation, __ATOMIC_ACQUIRE );
+		if ( g0 & 1 )
+			continue;
+		snap->newest_stamp  = seg->newest_stamp;
+		snap->plots         = seg->plots;
+		snap->plots_missing = seg->plots_missing;
+		snap->alerts_firing = seg->alerts_firing;
+		snap->pid           = seg->pid;
+		memcpy( snap->quarters, seg->quarters + PUBLISH_QUARTERS - numq, numq * sizeof(publish_quarter_t) );
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+		if ( __atomic_load_n( &seg->generation, __ATOMIC_RELAXED ) == g0 )
+			return 0;
+	}
+	return -1;
+}
+
+
+int main( int argc, char* argv[] )
+{
+	const int numq = argc > 1 ? atoi( argv[1] ) : 8;
+	const char* name = argc > 2 ? argv[2] : PUBLISH_NAME;
+	if ( numq < 1 || numq > PUBLISH_QUARTERS )
+	{
+		fprintf( stderr, "Usage: %s [numquarters [segmentname]]\n", argv[0] );
+		return 1;
+	}
+
+	const int fd = shm_open( name, O_RDONLY, 0 );
+	if ( fd < 0 )
+	{
+		fprintf( stderr, "No segment %s. Is chiaharvestgraph running?\n", name );
+		return 2;
+	}
+	struct stat st;
+	if ( fstat( fd, &st ) || st.st_size < (off_t) sizeof(publish_segment_t) )
+	{
+		fprintf( stderr, "Segment %s is too small.\n", name );
+		return 2;
+	}
+	const publish_segment_t* seg = (const publish_segment_t*) mmap( 0, sizeof(publish_segment_t), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( seg == MAP_FAILED )
+	{
+		perror( "mmap() failed" );
+		return 2;
+	}
+	if
+	(
+		seg->magic != PUBLISH_MAGIC ||
+		seg->version != PUBLISH_VERSION ||
+		seg->segment_size != sizeof(publish_segment_t) ||
+		seg->quarter_size != sizeof(publish_quarter_t) ||
+		seg->num_quarters != PUBLISH_QUARTERS
+	)
+	{
+		fprintf( stderr, "Segment %s has a layout that we do not know.\n", name );
+		return 2;
+	}
+
+	static snapshot_t snap;
+	if ( take_snapshot( seg, &snap, numq ) )
+	{
+		fprintf( stderr, "Could not get a consistent snapshot.\n" );
+		return 3;
+	}
+
+	printf( "pid %d, plots %d (%d missing), %d alerts firing\n", snap.pid, snap.plots, snap.plots_missing, snap.alerts_firing );
+	printf( "%-16s %7s %8s %6s %6s %8s %8s %9s\n", "quarter", "checks", "eligible", "proofs", "poolpr", "avg(ms)", "max(ms)", "expected" );
+	for ( int i=0; i<numq; ++i )
+	{
+		const publish_quarter_t* q = snap.quarters + i;
+		const time_t t = (time_t) q->timelo;
+		char tstr[ 32 ];
+		strftime( tstr, sizeof(tstr), "%Y-%m-%d %H:%M", localtime( &t ) );
+		printf
+		(
+			"%-16s %7d %8d %6d %6d %8.1f %8.1f %9.1f\n",
+			tstr, q->checks, q->eligible, q->proofs, q->poolpr, q->avg_lookup * 1000, q->max_lookup * 1000, q->eff_expected
+		);
+	}
+	return 0;
+}
+
@@ -0,0 +1,143 @@
+// splatency.c
+//
+// by Abraham Stolk.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "quarters.h"
+#include "splatency.h"
+
+
+void splat_init( splatency_t* sl )
+{
+	memset( sl, 0, sizeof(splatency_t) );
+}
+
+
+// The harvester logs the first 10 hex digits of the challenge hash, so that is all we use. A leading 0x is skipped.
+uint64_t splat_hash( const char* hex )
+{
+	if ( hex[0] == '0' && ( hex[1] == 'x' || hex[1] == 'X' ) )
+		hex += 2;
+	uint64_t h = 0;
+	int n = 0;
+	for ( ; n<10; ++n )
+	{
+		const char c = hex[ n ];
+		const int v = c >= '0' && c <= '9' ? c - '0' : ( c >= 'a' && c <= 'f' ? c - 'a' + 10 : ( c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1 ) );
+		if ( v < 0 )
+			break;
+		h = ( h << 4 ) | v;
+	}
+	return n == 10 ? h : 0;
+}
+
+
+static uint32_t home_slot( uint64_t hash )
+{
+	return (uint32_t) ( ( hash * 0x9e3779b97f4a7c15ull ) >> 56 ) & ( SPLAT_SLOTS - 1 );
+}
+
+
+void splat_signage_point( splatency_t* sl, uint64_t hash, stamp_t t )
+{
+	if ( !hash )
+		return;
+	const uint32_t home = home_slot( hash );
+	spslot_t* victim = 0;
+	for ( int p=0; p<SPLAT_PROBES; ++p )
+	{
+		spslot_t* s = sl->slots + ( ( home + p ) & ( SPLAT_SLOTS - 1 ) );
+		if ( s->hash == hash || !s->hash )
+		{
+			victim = s;	// A newer signage point for the same challenge replaces the older one.
+			break;
+		}
+		if ( !victim || s->t < victim->t )
+			victim = s;	// Table is crowded here: push out the oldest.
+	}
+	if ( victim->hash && !victim->joined && victim->hash != hash )
+		sl->evicted++;
+	victim->hash = hash;
+	victim->t = t;
+	victim->joined = 0;
+}
+
+
+static int latency_bin( stamp_t ms )
+{
+	const int b = (int) ( 4.0f * log2f( 1.0f + ( ms > 0 ? ms : 0 ) ) );
+	return b < SPLAT_BINS ? b : SPLAT_BINS-1;
+}
+
+
+// Joins a harvester line with its signage point. Returns the latency in ms, or -1 if there was no signage point for it.
+int splat_harvester( splatency_t* sl, uint64_t hash, stamp_t t )
+{
+	const uint32_t home = home_slot( hash );
+	for ( int p=0; p<SPLAT_PROBES && hash; ++p )
+	{
+		spslot_t* s = sl->slots + ( ( home + p ) & ( SPLAT_SLOTS - 1 ) );
+		if ( !s->hash )
+			break;
+		if ( s->hash != hash )
+			continue;
+		const stamp_t lat = t - s->t;
+		if ( s->joined || lat < 0 || lat > SPLAT_MAXAGE )
+			break;
+		s->joined = 1;
+		sl->joined++;
+
+		const time_t q = (time_t) ( t / 1000 / 900 );
+		const int idx = (int) ( q % MAXHIST );
+		if ( sl->qnr[ idx ] != q )
+		{
+			sl->qnr[ idx ] = q;
+			memset( sl->hist[ idx ], 0, sizeof(sl->hist[ idx ]) );
+		}
+		uint16_t* bin = sl->hist[ idx ] + latency_bin( lat );
+		*bin += *bin < UINT16_MAX;
+		return (int) lat;
+	}
+	sl->unjoined++;
+	return -1;
+}
+
+
+// Returns the pct-th percentile of the latencies in the quarters that overlap [from,to), in ms. Or -1 if there are none.
+int splat_percentile( const splatency_t* sl, time_t from, time_t to, int pct, int* count )
+{
+	int sums[ SPLAT_BINS ];
+	memset( sums, 0, sizeof(sums) );
+	int n = 0;
+	for ( time_t q = from / 900; q * 900 < to; ++q )
+	{
+		const int idx = (int) ( q % MAXHIST );
+		if ( sl->qnr[ idx ] != q )
+			continue;
+		for ( int b=0; b<SPLAT_BINS; ++b )
+		{
+			sums[ b ] += sl->hist[ idx ][ b ];
+			n += sl->hist[ idx ][ b ];
+		}
+	}
+	if ( count )
+		*count = n;
+	if ( !n )
+		return -1;
+	const int rank = ( n * pct + 99 ) / 100;
+	int acc = 0;
+	int b = 0;
+	for ( b=0; b<SPLAT_BINS-1; ++b )
+	{
+		acc += sums[ b ];
+		if ( acc >= rank )
+			break;
+	}
+	// The middle of the bin, on a log scale.
+	return (int) ( exp2f( ( b + 0.5f ) / 4.0f ) - 1.0f + 0.5f );
+}
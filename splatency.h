@@ -0,0 +1,43 @@
+// splatency.h
+//
+// by Abraham Stolk.
+
+// End-to-end signage point latency: from the farmer sending out a signage point, to the harvester being done with it.
+// Farmer and harvester lines are joined on the challenge hash, in a small hash table of recent signage points.
+// Several signage points share a challenge hash, so a harvester line is joined with the latest one before it.
+// The latencies go into a histogram per quarter-hour.
+// The way back to the farmer is not measured: the farmer only logs the responses that carry a proof.
+
+#define SPLAT_BINS		64	// Four bins per octave of milliseconds, up to a minute.
+#define SPLAT_SLOTS		256	// Signage points that we remember. About 40 minutes worth.
+#define SPLAT_PROBES		8	// Bounds the search in the table.
+#define SPLAT_MAXAGE		30000	// A harvester line that comes this many ms after its signage point, is not joined.
+
+typedef struct spslot
+{
+	uint64_t	hash;		// Challenge hash, first 40 bits. 0 means empty.
+	stamp_t		t;		// When the farmer sent it.
+	int		joined;		// Did we see the harvester line for it?
+} spslot_t;
+
+typedef struct splatency
+{
+	spslot_t	slots[ SPLAT_SLOTS ];
+	time_t		qnr[ MAXHIST ];			// Which quarter-hour (t/900) a histogram is for.
+	uint16_t	hist[ MAXHIST ][ SPLAT_BINS ];	// Latency histogram, per quarter-hour.
+	int		joined;				// Nr of harvester lines that we found the signage point for.
+	int		unjoined;			// Nr of harvester lines that we did not.
+	int		evicted;			// Nr of signage points that were pushed out before they were joined.
+} splatency_t;
+
+
+extern void splat_init( splatency_t* sl );
+
+extern void splat_signage_point( splatency_t* sl, uint64_t hash, stamp_t t );
+
+extern int  splat_harvester( splatency_t* sl, uint64_t hash, stamp_t t );
+
+extern int  splat_percentile( const splatency_t* sl, time_t from, time_t to, int pct, int* count );
+
+extern uint64_t splat_hash( const char* hex );
+
@@ -0,0 +1,305 @@
+// bench.c
+//
+// by Abraham Stolk.
+
+// Benchmarks of the hot paths: parsing log lines, aggregating the columns of the graph, and emitting frames.
+// Run from the top directory, with: make bench
+//
+// The results go into bench.json, and are compared with those in bench-baseline.json (or BENCH_BASELINE.)
+// A result that is more than BENCH_TOLERANCE (default 0.25) below its baseline, fails the run.
+// Without a baseline, the results become the baseline. It is local to the machine, so it is not checked in.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "harvestgraph.h"
+#include "grapher.h"
+#include "palette.h"
+#include "colagg.h"
+
+
+#define NOW		1791849600	// 2026-10-13T00:00:00Z
+#define PARSELINES	300000
+#define REPEATS		5		// We keep the best of these.
+
+typedef struct result
+{
+	const char*	name;
+	double		value;		// Higher is better.
+} result_t;
+
+static result_t results[ 32 ];
+static int numresults = 0;
+
+
+static double elapsed( const struct timespec* t0 )
+{
+	struct timespec t1;
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &t1 );
+	return ( t1.tv_sec - t0->tv_sec ) + 1e-9 * ( t1.tv_nsec - t0->tv_nsec );
+}
+
+
+static void record( const char* name, double value )
+{
+	results[ numresults ].name = name;
+	results[ numresults ].value = value;
+	numresults++;
+	printf( "%-24s %14.1f\n", name, value );
+}
+
+
+// Harvester lines of Chia 2.5, one for every signage point, going back from NOW.
+static char* make_log( size_t* len )
+{
+	const size_t cap = (size_t) PARSELINES * 256;
+	char* log = (char*) malloc( cap );
+	size_t n = 0;
+	time_t t = NOW - (time_t) PARSELINES * 9;
+	for ( int i=0; i<PARSELINES; ++i, t+=9 )
+	{
+		struct tm tim;
+		gmtime_r( &t, &tim );
+		n += snprintf
+		(
+			log + n, cap - n,
+			"%04d-%02d-%02dT%02d:%02d:%02d.%03d 2.5.7 harvester chia.harvester.harvester: INFO     challenge_hash: %08x ..."
+			"%d plots were eligible for farming challengeFound %d V1 proofs and 0 V2 qualities. Time: %.5f s. Total 250 plots\n",
+			tim.tm_year + 1900, tim.tm_mon + 1, tim.tm_mday, tim.tm_hour, tim.tm_min, tim.tm_sec, ( i * 37 ) % 1000,
+			i * 2654435761u, i % 3, i % 1000 == 0, 0.001 * ( i % 500 )
+		);
+	}
+	*len = n;
+	return log;
+}
+
+
+static int bench_parse( void )
+{
+	size_t len = 0;
+	char* log = make_log( &len );
+	double best = 1e9;
+	for ( int r=0; r<REPEATS; ++r )
+	{
+		harvestgraph_t* hg = hg_create( NOW );
+		struct timespec t0;
+		clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &t0 );
+		for ( size_t i=0; i<len; i+=65536 )
+			hg_feed_bytes( hg, log + i, i + 65536 < len ? 65536 : len - i );
+		hg_end_of_input( hg );
+		const double dt = elapsed( &t0 );
+		best = dt < best ? dt : best;
+		hg_stats_t st;
+		hg_stats( hg, &st );
+		hg_destroy( hg );
+		if ( st.matched != PARSELINES )
+		{
+			fprintf( stderr, "Only %llu of the %d lines were parsed.\n", (unsigned long long) st.matched, PARSELINES );
+			free( log );
+			return -1;
+		}
+	}
+	record( "parse_lines_per_s", PARSELINES / best );
+	record( "parse_mb_per_s", len / best / 1e6 );
+	free( log );
+	return 0;
+}
+
+
+// A full week of history: every quarter-hour holds the checks of all its 96 signage points.
+static harvestgraph_t* full_week( void )
+{
+	harvestgraph_t* hg = hg_create( NOW );
+	uint32_t seed = 1;
+	const int64_t start = ( NOW - (int64_t) HG_NUM_COLUMNS * 900 ) * 1000;
+	for ( int64_t t = start + 1000; t < NOW * 1000LL; t += 9375 )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const hg_entry_t e = { t, (int) ( seed >> 30 ), seed % 4099 == 0, 0.001f * ( seed >> 23 ), 250 };
+		hg_add_entry( hg, &e, 250 );
+	}
+	return hg;
+}
+
+
+static void bench_columns( harvestgraph_t* hg, const hg_palette_t* pal, int h, const char* name )
+{
+	uint32_t* pixels = (uint32_t*) calloc( (size_t) h * HG_NUM_COLUMNS, sizeof(uint32_t) );
+	const int sweeps = h > 100 ? 20 : 100;
+	double best = 1e9;
+	for ( int r=0; r<REPEATS; ++r )
+	{
+		struct timespec t0;
+		clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &t0 );
+		for ( int s=0; s<sweeps; ++s )
+			for ( int col=0; col<HG_NUM_COLUMNS; ++col )
+				hg_draw_column( hg, col, pixels + col, HG_NUM_COLUMNS, h, NOW - 60, pal );
+		const double dt = elapsed( &t0 );
+		best = dt < best ? dt : best;
+	}
+	record( name, (double) sweeps * HG_NUM_COLUMNS / best );
+	free( pixels );
+}
+
+
+// Every column aggregation kernel, on its own, over a full week of quarters with a check for every signage point.
+static void bench_kernels( int h )
+{
+	const int perq = 96;
+	int64_t* stamps = (int64_t*) malloc( (size_t) HG_NUM_COLUMNS * perq * sizeof(int64_t) );
+	int* eligib = (int*) malloc( (size_t) HG_NUM_COLUMNS * perq * sizeof(int) );
+	uint32_t seed = 1;
+	for ( int i=0; i<HG_NUM_COLUMNS*perq; ++i )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		stamps[ i ] = (int64_t) ( i / perq ) * COLAGG_SPAN + ( i % perq ) * 9375 + ( seed >> 24 );
+		eligib[ i ] = seed >> 30;
+	}
+	colagg_t ca;
+	colagg_init( &ca );
+	colagg_setup( &ca, h );
+	colagg_kernel_t kernels[ COLAGG_MAXKERNELS ];
+	const int numkernels = colagg_kernels( kernels );
+	static char names[ COLAGG_MAXKERNELS ][ 2 ][ 48 ];
+	for ( int k=0; k<numkernels; ++k )
+	{
+		double best = 0;
+		for ( int r=0; r<REPEATS; ++r )
+		{
+			struct timespec t0;
+			clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &t0 );
+			int sweeps = 0;
+			double dt;
+			do
+			{
+				for ( int q=0; q<HG_NUM_COLUMNS; ++q )
+					kernels[ k ].fn( &ca, stamps + q * perq, eligib + q * perq, eligib + q * perq, eligib + q * perq, perq, (int64_t) q * COLAGG_SPAN );
+				sweeps++;
+				dt = elapsed( &t0 );
+			} while ( dt < 0.05 );
+			const double rate = (double) sweeps * HG_NUM_COLUMNS / dt;
+			best = rate > best ? rate : best;
+		}
+		char* name = names[ k ][ h > 100 ];
+		snprintf( name, 48, "colagg_%s_h%d", kernels[ k ].name, h );
+		record( name, best );
+	}
+	colagg_free( &ca );
+	free( stamps );
+	free( eligib );
+}
+
+
+static void bench_frames( harvestgraph_t* hg, const hg_palette_t* pal )
+{
+	FILE* f = fopen( "/dev/null", "wb" );
+	grapher_init_headless( 200, 60 );
+	grapher_adapt_to_new_size();
+	for ( int col=0; col<imw-2; ++col )
+		hg_draw_column( hg, col, im + 5 * imw + imw-2-col, imw, imh-6, NOW - 60, pal );
+	snprintf( postscript, sizeof(postscript), "BENCH" );
+	const int frames = 200;
+	double best = 1e9;
+	for ( int r=0; r<REPEATS; ++r )
+	{
+		struct timespec t0;
+		clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &t0 );
+		for ( int i=0; i<frames; ++i )
+			grapher_print_frame( f );
+		fflush( f );
+		const double dt = elapsed( &t0 );
+		best = dt < best ? dt : best;
+	}
+	record( "frames_per_s_200x60", frames / best );
+	grapher_exit();
+	fclose( f );
+}
+
+
+static int write_results( const char* fname )
+{
+	FILE* f = fopen( fname, "w" );
+	if ( !f )
+		return -1;
+	fprintf( f, "{\n" );
+	for ( int i=0; i<numresults; ++i )
+		fprintf( f, "\t\"%s\": %.1f%s\n", results[ i ].name, results[ i ].value, i < numresults-1 ? "," : "" );
+	fprintf( f, "}\n" );
+	return fclose( f );
+}
+
+
+// Returns the nr of results that fell below their baseline, or -1 if there is no baseline.
+static int compare( const char* fname, double tolerance )
+{
+	FILE* f = fopen( fname, "r" );
+	if ( !f )
+		return -1;
+	int slower = 0;
+	char line[ 256 ];
+	while ( fgets( line, sizeof(line), f ) )
+	{
+		char name[ 64 ];
+		double base;
+		if ( sscanf( line, " \"%63[^\"]\": %lf", name, &base ) != 2 )
+			continue;
+		for ( int i=0; i<numresults; ++i )
+			if ( !strcmp( name, results[ i ].name ) )
+			{
+				const double ratio = results[ i ].value / base;
+				const int bad = ratio < 1.0 - tolerance;
+				printf( "%s %-24s %6.2fx of baseline\n", bad ? "SLOW" : "ok  ", name, ratio );
+				slower += bad;
+			}
+	}
+	fclose( f );
+	return slower;
+}
+
+
+int main( int argc, char* argv[] )
+{
+	setenv( "TZ", "UTC", 1 );
+	tzset();
+	const char* baseline = getenv( "BENCH_BASELINE" ) ? getenv( "BENCH_BASELINE" ) : "bench-baseline.json";
+	const double tolerance = getenv( "BENCH_TOLERANCE" ) ? atof( getenv( "BENCH_TOLERANCE" ) ) : 0.25;
+
+	if ( bench_parse() )
+		return 2;
+	harvestgraph_t* hg = full_week();
+	hg_palette_t pal;
+	setup_palette( &pal );
+	bench_columns( hg, &pal, 40, "columns_per_s_h40" );
+	bench_columns( hg, &pal, 1000, "columns_per_s_h1000" );
+	bench_kernels( 40 );
+	bench_kernels( 1000 );
+	bench_frames( hg, &pal );
+	hg_destroy( hg );
+
+	if ( write_results( "bench.json" ) )
+	{
+		fprintf( stderr, "Could not write bench.json\n" );
+		return 2;
+	}
+	const int slower = compare( baseline, tolerance );
+	if ( slower < 0 )
+	{
+		if ( write_results( baseline ) )
+		{
+			fprintf( stderr, "Could not write %s\n", baseline );
+			return 2;
+		}
+		printf( "No baseline yet: wrote %s\n", baseline );
+		return 0;
+	}
+	if ( slower )
+	{
+		fprintf( stderr, "%d result(s) more than %.0f%% below %s.\n", slower, 100 * tolerance, baseline );
+		return 1;
+	}
+	return 0;
+}
+
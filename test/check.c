@@ -0,0 +1,576 @@
+// check.c
+//
+// by Abraham Stolk.
+
+// Golden tests for libharvestgraph and the grapher. Run from the top directory, with: make check
+// Every test writes what it sees as text, which must match its file in test/golden/ to the byte.
+// When a change of the output is intended, run: UPDATE_GOLDEN=1 make check
+// and review the diff of test/golden/ before committing it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "harvestgraph.h"
+#include "grapher.h"
+#include "palette.h"
+#include "colagg.h"
+
+
+#define NOW		1791849600	// 2026-10-13T00:00:00Z. The tests run in UTC.
+#define LONGLINESZ	( 64 << 10 )
+#define HUGELINESZ	( 1 << 20 )
+
+static int failures = 0;
+
+
+static char* slurp( const char* fname, size_t* len )
+{
+	FILE* f = fopen( fname, "rb" );
+	if ( !f )
+		return 0;
+	char* buf = 0;
+	size_t cap = 0;
+	*len = 0;
+	size_t n;
+	do
+	{
+		if ( *len + 65536 > cap )
+		{
+			cap = 2 * ( *len + 65536 );
+			buf = (char*) realloc( buf, cap );
+		}
+		n = fread( buf + *len, 1, cap - *len, f );
+		*len += n;
+	} while ( n );
+	fclose( f );
+	return buf;
+}
+
+
+static void report_line( const char* what, const char* s, const char* end )
+{
+	const char* nl = memchr( s, '\n', end - s );
+	const int n = (int) ( ( nl ? nl : end ) - s );
+	fprintf( stderr, "  %s: %.*s\n", what, n > 200 ? 200 : n, s );
+}
+
+
+// Compares the output of a test with its golden file, and shows the first line that differs.
+static void check_golden( const char* name, const char* out, size_t len )
+{
+	char fname[ 256 ];
+	snprintf( fname, sizeof(fname), "test/golden/%s.txt", name );
+	if ( getenv( "UPDATE_GOLDEN" ) )
+	{
+		FILE* f = fopen( fname, "wb" );
+		if ( !f || fwrite( out, 1, len, f ) != len || fclose( f ) )
+		{
+			fprintf( stderr, "FAIL %s: could not write %s\n", name, fname );
+			failures++;
+			return;
+		}
+		printf( "updated %s\n", fname );
+		return;
+	}
+	size_t glen = 0;
+	char* golden = slurp( fname, &glen );
+	if ( !golden )
+	{
+		fprintf( stderr, "FAIL %s: no golden file %s\n", name, fname );
+		failures++;
+		return;
+	}
+	if ( glen == len && !memcmp( golden, out, len ) )
+	{
+		printf( "ok   %s\n", name );
+		free( golden );
+		return;
+	}
+	size_t i = 0;
+	int line = 1;
+	while ( i < len && i < glen && out[ i ] == golden[ i ] )
+		line += out[ i++ ] == '\n';
+	while ( i > 0 && out[ i-1 ] != '\n' )
+		i--;
+	fprintf( stderr, "FAIL %s: differs from %s at line %d\n", name, fname, line );
+	report_line( "expected", golden + i, golden + glen );
+	report_line( "got     ", out + i, out + len );
+	failures++;
+	free( golden );
+}
+
+
+static void expect( const char* name, int ok )
+{
+	if ( ok )
+		printf( "ok   %s\n", name );
+	else
+	{
+		fprintf( stderr, "FAIL %s\n", name );
+		failures++;
+	}
+}
+
+
+// The lines of test/lines.txt, followed by two lines that are too long: a good line that goes on and on, and a megabyte of junk.
+static char* parse_input( size_t* len )
+{
+	size_t flen = 0;
+	char* file = slurp( "test/lines.txt", &flen );
+	if ( !file )
+		return 0;
+	const char* good = "2026-10-12T10:17:29.000 2.5.7 harvester chia.harvester.harvester: INFO     challenge_hash: d361ad68d9 ...1 plots were eligible for farming challengeFound 0 V1 proofs and 0 V2 qualities. Time: 0.01000 s. Total 250 plots ";
+	char* buf = (char*) malloc( flen + LONGLINESZ + HUGELINESZ + 2 );
+	memcpy( buf, file, flen );
+	char* p = buf + flen;
+	const size_t goodlen = strlen( good );
+	memcpy( p, good, goodlen );
+	memset( p + goodlen, 'x', LONGLINESZ - goodlen );
+	p += LONGLINESZ;
+	*p++ = '\n';
+	memset( p, ' ', HUGELINESZ );
+	memcpy( p + 1000, " harvester ", 11 );
+	memcpy( p + 500000, "eligible", 8 );
+	p += HUGELINESZ;
+	*p++ = '\n';
+	*len = p - buf;
+	free( file );
+	return buf;
+}
+
+
+static void describe( FILE* f, harvestgraph_t* hg )
+{
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	fprintf
+	(
+		f, "entries=%d plots=%d missing=%d runs=%d avg=%.5f worst=%.5f farmer=%d pool=%d matched=%llu rejected=%llu\n",
+		st.entries, st.plots, st.plots_missing, st.plot_runs, st.avg_check, st.worst_check, st.farmer_log, st.pool_proofs,
+		(unsigned long long) st.matched, (unsigned long long) st.rejected
+	);
+	char grammars[ 256 ];
+	hg_grammar_format( hg, grammars, sizeof(grammars) );
+	fprintf( f, "%s\n", grammars );
+	fprintf( f, "sp-latency p50=%d p95=%d\n", hg_sp_latency( hg, NOW - 86400, NOW, 50 ), hg_sp_latency( hg, NOW - 86400, NOW, 95 ) );
+	for ( int col=0; col<HG_NUM_COLUMNS; ++col )
+	{
+		hg_column_t c;
+		hg_column( hg, col, &c );
+		if ( c.checks )
+			fprintf
+			(
+				f, "column %d: timelo=%lld checks=%d eligible=%d proofs=%d poolpr=%d avg=%.5f max=%.5f eff=%d/%.4f/%.4f\n",
+				col, (long long) c.timelo, c.checks, c.eligible, c.proofs, c.poolpr, c.avg_lookup, c.max_lookup,
+				c.eff_observed, c.eff_expected, c.eff_variance
+			);
+	}
+	fflush( f );
+	hg_export( hg, f, 0, 0, NOW );
+}
+
+
+// Harvester lines of every version, farmer lines, and lines that are broken in all sorts of ways.
+static void test_parse( void )
+{
+	size_t len = 0;
+	char* input = parse_input( &len );
+	if ( !input )
+	{
+		expect( "parse: read test/lines.txt", 0 );
+		return;
+	}
+
+	char* out = 0;
+	size_t outlen = 0;
+	FILE* f = open_memstream( &out, &outlen );
+	harvestgraph_t* hg = hg_create( NOW );
+	int nr = 0;
+	for ( size_t i=0; i<len; )
+	{
+		const char* nl = memchr( input + i, '\n', len - i );
+		const size_t ll = nl + 1 - ( input + i );
+		char* line = (char*) malloc( ll + 1 );
+		memcpy( line, input + i, ll );
+		line[ ll ] = 0;
+		fprintf( f, "line %d: %d\n", ++nr, hg_feed_line( hg, line, ll ) );
+		free( line );
+		i += ll;
+	}
+	fprintf( f, "end: %d\n", hg_end_of_input( hg ) );
+	describe( f, hg );
+	fclose( f );
+	check_golden( "parse", out, outlen );
+
+	// The same bytes, cut up at odd places, or all in one go, must give the same history.
+	const char* exp = strstr( out, "entries=" );
+	for ( int whole=0; whole<2; ++whole )
+	{
+		char* out2 = 0;
+		size_t outlen2 = 0;
+		f = open_memstream( &out2, &outlen2 );
+		harvestgraph_t* hb = hg_create( NOW );
+		nr = 0;
+		for ( size_t i=0, k=0; i<len; ++k )
+		{
+			const size_t n = whole ? len : k % 3 ? 1 + k % 13 : 4093;
+			const size_t chunk = i + n < len ? n : len - i;
+			nr += hg_feed_bytes( hb, input + i, chunk );
+			i += chunk;
+		}
+		hg_end_of_input( hb );
+		describe( f, hb );
+		fclose( f );
+		expect( whole ? "parse: bytes fed in one go" : "parse: bytes fed in pieces", nr == 31 && exp && strlen( exp ) == outlen2 && !memcmp( exp, out2, outlen2 ) );
+		hg_destroy( hb );
+		free( out2 );
+	}
+
+	hg_destroy( hg );
+	free( out );
+	free( input );
+}
+
+
+static void add( FILE* f, harvestgraph_t* hg, int64_t t, int plots )
+{
+	const hg_entry_t e = { t, 1, 0, 0.05f, plots };
+	const int r = hg_add_entry( hg, &e, plots );
+	hg_stats_t st;
+	hg_stats( hg, &st );
+	time_t lo0, lo1;
+	const int sz0 = hg_column_entries( hg, 0, &lo0 );
+	const int sz1 = hg_column_entries( hg, 1, &lo1 );
+	int total = 0;
+	for ( int col=0; col<HG_NUM_COLUMNS; ++col )
+		total += hg_column_entries( hg, col, 0 );
+	fprintf
+	(
+		f, "add %+.3f: %d shifts=%llu newest=%+lld col0=%+lld:%d col1=%+lld:%d total=%d plots=%d runs=%d\n",
+		( t - NOW * 1000LL ) / 1000.0, r, (unsigned long long) st.shifts,
+		(long long) ( st.newest_stamp ? st.newest_stamp / 1000 - NOW : 0 ),
+		(long long) ( lo0 - NOW ), sz0, (long long) ( lo1 - NOW ), sz1, total, st.plots, st.plot_runs
+	);
+}
+
+
+// The bookkeeping of the quarters: edges, entries out of order, a full quarter, and jumps ahead in time.
+static void test_quarters( void )
+{
+	char* out = 0;
+	size_t outlen = 0;
+	FILE* f = open_memstream( &out, &outlen );
+	harvestgraph_t* hg = hg_create( NOW );
+	const int64_t ms = (int64_t) NOW * 1000;
+	const int64_t oldest = ms - (int64_t) ( HG_NUM_COLUMNS - 1 ) * 900000;
+
+	add( f, hg, ms, 250 );
+	add( f, hg, ms + 899999, 250 );
+	add( f, hg, ms - 1, 250 );
+	add( f, hg, ms + 450000, 250 );		// Out of order, within the same quarter.
+	add( f, hg, oldest, 250 );		// The oldest quarter does not take entries at its very start.
+	add( f, hg, oldest + 1000, 250 );
+	add( f, hg, oldest - 1, 250 );
+	add( f, hg, ms + 900000, 240 );		// Into the next quarter: one shift.
+	add( f, hg, ms + 900001, 240 );
+	add( f, hg, ms + 900002, 240 );		// The new plot count is confirmed now.
+	for ( int i=0; i<400; ++i )		// Fill a quarter past what it holds.
+		add( f, hg, ms + 1800000 + i * 2000, 240 );
+	add( f, hg, ms + 86400000, 240 );	// A day ahead.
+	add( f, hg, ms + 30 * 86400000LL, 250 );	// A month ahead: nothing of before remains.
+	add( f, hg, ms + 86400000, 250 );	// Which is too old now.
+	add( f, hg, ms + 30 * 86400000LL - 1000, 250 );
+	add( f, hg, 4102444800000LL, 250 );	// Year 2100.
+	fclose( f );
+	check_golden( "quarters", out, outlen );
+	hg_destroy( hg );
+	free( out );
+}
+
+
+// Plot drops count in the day that they happened, also when that day is older than the graph.
+// Both days go from 250 to 240 plots, and the second day starts with the recovery to 250.
+static void test_days( void )
+{
+	harvestgraph_t* hg = hg_create( NOW );
+	for ( int ago=40; ago>=3; ago-=37 )
+		for ( int i=0; i<1000; ++i )
+		{
+			const int plots = i < 500 ? 250 : 240;
+			const hg_entry_t e = { ( NOW - ago * 86400LL ) * 1000 + i * 9375LL, 1, 0, 0.01f, plots };
+			hg_add_entry( hg, &e, plots );
+		}
+	hg_day_t days[ 4 ];
+	const int n = hg_days( hg, days, 4, NOW, 0 );
+	expect( "days: plot drops of old days", n == 2 && days[ 0 ].plot_changes == 1 && days[ 0 ].plot_drops == 1 && days[ 1 ].plot_changes == 2 && days[ 1 ].plot_drops == 1 );
+	hg_destroy( hg );
+}
+
+
+static void feed_days( harvestgraph_t* hg, int64_t from, int64_t to )
+{
+	for ( int64_t t = from; t < to; t += 9375 )
+	{
+		const int plots = t > ( NOW - 86400 ) * 1000LL ? 240 : 250;
+		const hg_entry_t e = { t, (int) ( t / 9375 % 3 ), t / 9375 % 500 == 0, 0.001f * ( t / 9375 % 700 ), plots };
+		hg_add_entry( hg, &e, plots );
+	}
+}
+
+
+static int same_days( const hg_day_t* a, const hg_day_t* b, int n )
+{
+	for ( int i=0; i<n; ++i )
+		if
+		(
+			a[ i ].start != b[ i ].start || a[ i ].checks != b[ i ].checks || a[ i ].eligible != b[ i ].eligible ||
+			a[ i ].proofs != b[ i ].proofs || a[ i ].up_quarters != b[ i ].up_quarters || a[ i ].quarters != b[ i ].quarters ||
+			a[ i ].lookup_p99 != b[ i ].lookup_p99 || a[ i ].plots_last != b[ i ].plots_last ||
+			a[ i ].plot_changes != b[ i ].plot_changes || a[ i ].plot_drops != b[ i ].plot_drops
+		)
+			return 0;
+	return 1;
+}
+
+
+// Days that were saved halfway, and then given all of the entries again, must add up to the days of one pass.
+static void test_kept_days( void )
+{
+	const int64_t from = ( NOW - 3 * 86400 ) * 1000LL;
+	const int64_t half = ( NOW - 36 * 3600 ) * 1000LL;
+	harvestgraph_t* hg = hg_create( NOW );
+	feed_days( hg, from, NOW * 1000LL );
+	hg_day_t want[ 5 ];
+	const int n = hg_days( hg, want, 5, NOW, 0 );
+	hg_destroy( hg );
+
+	hg = hg_create( NOW );
+	feed_days( hg, from, half );
+	FILE* f = tmpfile();
+	const int saved = hg_save_days( hg, f );
+	hg_destroy( hg );
+	rewind( f );
+	hg = hg_create( NOW );
+	int64_t last = 0;
+	const int loaded = hg_load_days( hg, f, &last );
+	fclose( f );
+	feed_days( hg, from, NOW * 1000LL );
+	hg_day_t got[ 5 ];
+	int m = hg_days( hg, got, 5, NOW, 0 );
+	hg_destroy( hg );
+	expect( "days: saved and loaded", !saved && loaded == 2 && last >= half - 9375 && last < half );
+	expect( "days: entries that the kept days hold are not counted again", n == 3 && m == n && same_days( want, got, n ) && want[ 1 ].plot_changes == 0 && want[ 2 ].plot_drops == 1 );
+
+	// The same for an export, followed by entries that overlap with it.
+	hg = hg_create( NOW );
+	feed_days( hg, from, half );
+	f = tmpfile();
+	hg_export( hg, f, 1, 0, NOW );
+	hg_destroy( hg );
+	rewind( f );
+	hg = hg_create( NOW );
+	const long nrows = hg_import( hg, f, 0, &last );
+	fclose( f );
+	feed_days( hg, from, NOW * 1000LL );
+	m = hg_days( hg, got, 5, NOW, 0 );
+	hg_destroy( hg );
+	expect( "days: entries that an import holds are not counted again", nrows > 0 && m == n && same_days( want, got, n ) );
+}
+
+
+// Exports of version 1 have their stamps in seconds, in the CSV as well.
+static void test_import_v1( void )
+{
+	char csv[] = "stamps,eligib,proofs,poolpr,durati\n1791763200,1,0,0,0.25000\n1791763209,2,1,0,0.50000\n";
+	FILE* f = fmemopen( csv, strlen( csv ), "r" );
+	harvestgraph_t* hg = hg_create( NOW );
+	int64_t last = 0;
+	const long nrows = hg_import( hg, f, 0, &last );
+	fclose( f );
+	hg_day_t days[ 2 ];
+	const int n = hg_days( hg, days, 2, NOW, 0 );
+	hg_destroy( hg );
+	expect( "import: csv of version 1", nrows == 2 && last == 1791763209000LL && n == 1 && days[ 0 ].start == NOW - 86400 && days[ 0 ].checks == 2 );
+}
+
+
+// Two days of checks, with an outage, a slow patch, a plot drop and its recovery, and some proofs.
+static harvestgraph_t* synthetic_history( void )
+{
+	harvestgraph_t* hg = hg_create( NOW );
+	uint32_t seed = 12345;
+	for ( int64_t t = ( NOW - 2 * 86400 ) * 1000LL; t < NOW * 1000LL; )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const int64_t h = ( t / 1000 - ( NOW - 2 * 86400 ) ) / 3600;
+		const int plots = h >= 20 && h < 23 ? 240 : 250;
+		const hg_entry_t e = { t, (int) ( seed >> 30 ), seed % 997 == 0, 0.01f * ( seed >> 26 ), plots };
+		if ( h != 10 )
+			hg_add_entry( hg, &e, plots );
+		t += h >= 30 && h < 33 ? 18750 : 9375;
+	}
+	return hg;
+}
+
+
+// Draws the history like the tool does, and prints the frame that it would send to the terminal.
+static void draw_frame( FILE* f, harvestgraph_t* hg, const hg_palette_t* pal, int w, int h )
+{
+	grapher_init_headless( w, h );
+	grapher_adapt_to_new_size();
+	uint32_t* graph = im + 5 * imw;
+	const int graphh = imh - 6;
+	for ( int col=0; col<imw-2; ++col )
+		hg_draw_column( hg, col, graph + imw-2-col, imw, graphh, NOW - 60, pal );
+	snprintf( overlay, imw, "TEST %dx%d", w, h );
+	snprintf( postscript, sizeof(postscript), "END" );
+	grapher_print_frame( f );
+}
+
+
+static uint64_t fnv1a( const char* s, size_t len )
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for ( size_t i=0; i<len; ++i )
+		hash = ( hash ^ (uint8_t) s[ i ] ) * 0x100000001b3ULL;
+	return hash;
+}
+
+
+static void test_frames( void )
+{
+	static const int sizes[][ 2 ] = { { 80, 48 }, { 200, 60 }, { HG_NUM_COLUMNS + 2, 30 } };
+	harvestgraph_t* hg = synthetic_history();
+	hg_palette_t pal;
+	setup_palette( &pal );
+	char* out = 0;
+	size_t outlen = 0;
+	FILE* f = open_memstream( &out, &outlen );
+	for ( size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); ++i )
+	{
+		char* frame = 0;
+		size_t framelen = 0;
+		FILE* ff = open_memstream( &frame, &framelen );
+		draw_frame( ff, hg, &pal, sizes[ i ][ 0 ], sizes[ i ][ 1 ] );
+		fclose( ff );
+		fprintf( f, "%dx%d: %zu bytes, fnv1a %016llx\n", sizes[ i ][ 0 ], sizes[ i ][ 1 ], framelen, (unsigned long long) fnv1a( frame, framelen ) );
+		free( frame );
+	}
+	fclose( f );
+	check_golden( "frames", out, outlen );
+	grapher_exit();
+	hg_destroy( hg );
+	free( out );
+}
+
+
+static int same_rows( const colagg_t* a, const colagg_t* b, int h )
+{
+	return
+		!memcmp( a->checks, b->checks, h * sizeof(int) ) && !memcmp( a->eligib, b->eligib, h * sizeof(int) ) &&
+		!memcmp( a->proofs, b->proofs, h * sizeof(int) ) && !memcmp( a->poolpr, b->poolpr, h * sizeof(int) );
+}
+
+
+// Every column aggregation kernel that the cpu can run, must count the same as the reference does, to the bit.
+// Besides normal quarters, the stamps hit every row edge, and fall outside the quarter, also by multiples of 2^32 ms.
+static void test_colagg( void )
+{
+	static const int heights[] = { 1, 2, 3, 7, 40, 54, 127, 128, 129, 1000, 4099 };
+	static const int64_t outside[] = { -1, -900000, 900000, 900001, 1LL << 32, ( 1LL << 32 ) + 5, -( 1LL << 32 ) + 5, 1LL << 40 };
+	colagg_kernel_t kernels[ COLAGG_MAXKERNELS ];
+	const int numkernels = colagg_kernels( kernels );
+	int mismatches[ COLAGG_MAXKERNELS ] = { 0 };
+	const int cap = 2 * 4100 + 400;
+	int64_t* stamps = (int64_t*) malloc( cap * sizeof(int64_t) );
+	int* eligib = (int*) malloc( 3 * cap * sizeof(int) );
+	int* proofs = eligib + cap;
+	int* poolpr = eligib + 2 * cap;
+	uint32_t seed = 777;
+	int cases = 0;
+	for ( size_t hi=0; hi<sizeof(heights)/sizeof(heights[0]); ++hi )
+	{
+		const int h = heights[ hi ];
+		colagg_t ref, out;
+		colagg_init( &ref );
+		colagg_init( &out );
+		colagg_setup( &ref, h );
+		colagg_setup( &out, h );
+		for ( int kind=0; kind<4; ++kind )
+		{
+			const int64_t qlo = NOW * 1000LL + ( kind & 1 ? 123 : 0 );
+			int sz = 0;
+			if ( kind < 2 )
+			{
+				// A quarter of checks, some of them in the same ms.
+				int64_t t = qlo + 17;
+				for ( int i=0; i<360 && t < qlo + COLAGG_SPAN; ++i )
+				{
+					seed = seed * 1664525u + 1013904223u;
+					stamps[ sz++ ] = t;
+					t += seed % 5 == 0 ? 0 : 1000 + ( seed >> 20 ) % 9000;
+				}
+			}
+			else
+			{
+				for ( int y=0; y<=h; ++y )
+				{
+					stamps[ sz++ ] = qlo + ref.binoff[ y ] - 1;
+					stamps[ sz++ ] = qlo + ref.binoff[ y ];
+				}
+				for ( size_t i=0; i<sizeof(outside)/sizeof(outside[0]); ++i )
+					stamps[ sz++ ] = qlo + outside[ i ];
+			}
+			for ( int i=0; i<sz; ++i )
+			{
+				seed = seed * 1664525u + 1013904223u;
+				eligib[ i ] = seed >> 30;
+				proofs[ i ] = ( seed >> 8 ) % 7 == 0;
+				poolpr[ i ] = ( seed >> 12 ) % 5 == 0;
+			}
+			colagg_reference( &ref, stamps, eligib, proofs, poolpr, sz, qlo );
+			for ( int k=0; k<numkernels; ++k )
+			{
+				memset( out.checks, 0x55, h * sizeof(int) );
+				kernels[ k ].fn( &out, stamps, eligib, proofs, poolpr, sz, qlo );
+				mismatches[ k ] += !same_rows( &ref, &out, h );
+			}
+			cases++;
+		}
+		colagg_free( &ref );
+		colagg_free( &out );
+	}
+	for ( int k=0; k<numkernels; ++k )
+	{
+		char name[ 80 ];
+		snprintf( name, sizeof(name), "colagg: %s kernel, %d cases", kernels[ k ].name, cases );
+		expect( name, !mismatches[ k ] );
+	}
+	free( stamps );
+	free( eligib );
+}
+
+
+int main( int argc, char* argv[] )
+{
+	setenv( "TZ", "UTC", 1 );	// Log stamps are local time.
+	tzset();
+	test_parse();
+	test_quarters();
+	test_days();
+	test_kept_days();
+	test_import_v1();
+	test_frames();
+	test_colagg();
+	if ( failures )
+	{
+		fprintf( stderr, "%d test(s) failed.\n", failures );
+		return 1;
+	}
+	printf( "All tests passed.\n" );
+	return 0;
+}
+
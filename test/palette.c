@@ -0,0 +1,29 @@
+// palette.c
+//
+// by Abraham Stolk.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "harvestgraph.h"
+#include "colourmaps.h"
+#include "palette.h"
+
+
+static uint32_t pack_rgb( uint32_t red, uint32_t grn, uint32_t blu )
+{
+	return (0xffu<<24) | (blu<<16) | (grn<<8) | (red<<0);
+}
+
+
+void setup_palette( hg_palette_t* pal )
+{
+	for ( int band=0; band<2; ++band )
+	{
+		const uint32_t num = band ? 200 : 255;
+		for ( int idx=0; idx<256; ++idx )
+			pal->ramp[ band ][ idx ] = pack_rgb( cmap_heat[ idx ][ 0 ] * num / 255, cmap_heat[ idx ][ 1 ] * num / 255, cmap_heat[ idx ][ 2 ] * num / 255 );
+		pal->grey[ band ] = pack_rgb( 0x36 * num / 255, 0x36 * num / 255, 0x36 * num / 255 );
+	}
+}
+
@@ -0,0 +1,9 @@
+// palette.h
+//
+// by Abraham Stolk.
+
+// The palette that the tool builds from the heat colour map, for the tests and the benchmarks.
+// Include harvestgraph.h first.
+
+extern void setup_palette( hg_palette_t* pal );
+